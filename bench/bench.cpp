@@ -0,0 +1,442 @@
+//
+// bench.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MOS6502/Lockstep.h"
+#include "MOS6502/MOS6502T.h"
+
+//
+// Dispatch-loop microbenchmarks against a trivial flat-RAM bus.
+//
+// Every implemented opcode is timed on its own, repeated through a page of
+// code that ends in a JMP back to the start, followed by a few mixed
+// workloads, each also run on LANES seeded copies one after another and
+// then in Lockstep. Results go to stdout as a table and, with --csv, to a
+// file for comparing builds.
+//
+
+// Flat 64 KiB of RAM; Load/Store are the whole bus, unless --mapped puts the
+// same memory in the core's page table.
+class Flat : public MOS6502T<Flat, Nmos6502Illegal> {
+
+public:
+
+  explicit Flat(bool mapped) {
+    if (mapped) { MapPages(0x0000, 0x10000, memory, memory); }
+  }
+
+  uint8_t Load(uint16_t address, bool = false) { return memory[address]; }
+  void Store(uint16_t address, uint8_t value) { memory[address] = value; }
+
+  uint8_t memory[0x10000] = {};
+
+};
+
+struct Result {
+  std::string opcode;
+  std::string name;
+  std::string kind;
+  std::string mode;
+  double cyclesPerInstruction = 0;
+  double nsPerInstruction = 0;
+  double mhz = 0;
+};
+
+struct Options {
+  bool mapped = false;
+  uint64_t cycles = 4'000'000;
+  int repeats = 3;
+  const char *csv = nullptr;
+};
+
+static constexpr uint16_t CODE   = 0x1000;
+static constexpr uint16_t VECTOR = 0x2000;  // BRK handler and JSR target
+static constexpr int      COPIES = 256;
+static constexpr size_t   LANES  = 16;
+
+static const char *MODE_NAMES[] = {
+  "imp", "acc", "imm", "zp", "zp,x", "zp,y", "abs", "abs,x", "abs,y", "(abs)", "(zp,x)", "(zp),y", "rel",
+};
+
+static const char *KIND_NAMES[] = { "official", "illegal", "unknown" };
+
+// Fresh machine with the reset vector at CODE, a pointer at $10 to $0300
+// for the indirect modes, and `code` followed by JMP CODE.
+static std::unique_ptr<Flat> Build(const Options &options, const std::vector<uint8_t> &code) {
+  auto machine = std::make_unique<Flat>(options.mapped);
+  uint8_t *memory = machine->memory;
+
+  std::copy(code.begin(), code.end(), memory + CODE);
+  const uint16_t end = static_cast<uint16_t>(CODE + code.size());
+  memory[end + 0] = 0x4C;
+  memory[end + 1] = CODE & 0xFF;
+  memory[end + 2] = CODE >> 8;
+
+  memory[0x10] = 0x00; memory[0x11] = 0x03;
+  memory[0x12] = CODE & 0xFF; memory[0x13] = CODE >> 8;
+
+  memory[VECTOR] = 0x40;      // RTI, for BRK
+  memory[VECTOR + 1] = 0x60;  // RTS, for JSR
+
+  memory[0xFFFC] = CODE & 0xFF; memory[0xFFFD] = CODE >> 8;
+  memory[0xFFFE] = VECTOR & 0xFF; memory[0xFFFF] = VECTOR >> 8;
+
+  machine->Reset();
+  return machine;
+}
+
+// Runs the program for the cycle budget, best of the repeats. The JMP that
+// Build() appends is left out of the figures: its cycles and instruction
+// are taken off each pass, and its share of the time by its share of the
+// cycles.
+static Result Measure(const Options &options, const std::vector<uint8_t> &code, bool cache = false) {
+  Result result;
+  double best = 1e30;
+  uint64_t cycles = 0;
+  uint64_t passCycles = 0;
+  uint64_t passInstructions = 0;
+  uint64_t jumpCycles = 0;
+  uint64_t jumpInstructions = 0;
+  const uint16_t jump = static_cast<uint16_t>(CODE + code.size());
+
+  for (int repeat = 0; repeat < options.repeats; repeat++) {
+    auto machine = Build(options, code);
+    machine->EnableCodeCache(cache);
+
+    // One pass by hand, back round to CODE, to learn its length.
+    passCycles = passInstructions = jumpCycles = jumpInstructions = 0;
+    do {
+      const bool jumping = machine->GetRegisters().PC == jump;
+      const uint32_t used = machine->Step();
+      passCycles += used;
+      passInstructions++;
+      if (jumping) {
+        jumpCycles += used;
+        jumpInstructions++;
+      }
+    } while (machine->GetRegisters().PC != CODE);
+
+    const auto start = std::chrono::steady_clock::now();
+    cycles = machine->Run(options.cycles);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = std::min(best, seconds);
+  }
+
+  const double passes       = static_cast<double>(cycles) / passCycles;
+  const double instructions = passes * (passInstructions - jumpInstructions);
+  const double seconds      = best * (passCycles - jumpCycles) / passCycles;
+  result.cyclesPerInstruction = static_cast<double>(passCycles - jumpCycles) / (passInstructions - jumpInstructions);
+  result.nsPerInstruction     = seconds * 1e9 / instructions;
+  result.mhz                  = cycles / best / 1e6;
+  return result;
+}
+
+// COPIES repetitions of one instruction, or of a pair that must run
+// together to keep the stack and control flow balanced.
+static bool Sequence(uint8_t opcode, std::vector<uint8_t> &code, std::string &name) {
+  const OpcodeInfo &info = OPCODE_INFO[opcode];
+  name = info.mnemonic;
+
+  auto repeat = [&](std::initializer_list<uint8_t> bytes) {
+    for (int copy = 0; copy < COPIES; copy++) { code.insert(code.end(), bytes); }
+  };
+
+  switch (opcode) {
+    case 0x00: name = "BRK+RTI"; repeat({ 0x00, 0xEA }); return true;
+    case 0x20: name = "JSR+RTS"; repeat({ 0x20, (VECTOR + 1) & 0xFF, (VECTOR + 1) >> 8 }); return true;
+    case 0x08: name = "PHP+PLP"; repeat({ 0x08, 0x28 }); return true;
+    case 0x48: name = "PHA+PLA"; repeat({ 0x48, 0x68 }); return true;
+    case 0x28: case 0x40: case 0x60: case 0x68:
+      return false;  // measured with their partners above
+
+    case 0x4C:  // chain of jumps to the next instruction
+      for (int copy = 0; copy < COPIES; copy++) {
+        const uint16_t next = static_cast<uint16_t>(CODE + code.size() + 3);
+        code.insert(code.end(), { 0x4C, static_cast<uint8_t>(next & 0xFF), static_cast<uint8_t>(next >> 8) });
+      }
+      return true;
+
+    case 0x6C:  // JMP ($0012) back to the start; the trailing JMP never runs
+      code = { 0x6C, 0x12, 0x00 };
+      return true;
+  }
+
+  if (info.kind == OpcodeInfo::UNKNOWN) { return false; }
+
+  switch (info.mode) {
+    case OpcodeInfo::IMP:
+    case OpcodeInfo::ACC: repeat({ opcode }); break;
+    case OpcodeInfo::IMM: repeat({ opcode, 0x01 }); break;
+    case OpcodeInfo::REL: repeat({ opcode, 0x00 }); break;  // either way lands on the next one
+    case OpcodeInfo::IZX:
+    case OpcodeInfo::IZY: repeat({ opcode, 0x10 }); break;
+    case OpcodeInfo::ZPG:
+    case OpcodeInfo::ZPX:
+    case OpcodeInfo::ZPY: repeat({ opcode, 0x20 }); break;
+    default:              repeat({ opcode, 0x00, 0x03 }); break;
+  }
+
+  return true;
+}
+
+//
+// Mixed workloads, each an endless loop at CODE.
+//
+
+// 8x8 shift-and-add multiply.
+static const std::vector<uint8_t> ARITHMETIC = {
+  0xA9, 0x5A,        // LDA #$5A
+  0x85, 0x20,        // STA $20
+  0xA9, 0xC3,        // LDA #$C3
+  0x85, 0x21,        // STA $21
+  0xA9, 0x00,        // LDA #0
+  0xA2, 0x08,        // LDX #8
+  0x46, 0x21,        // loop: LSR $21
+  0x90, 0x03,        // BCC skip
+  0x18,              // CLC
+  0x65, 0x20,        // ADC $20
+  0x6A,              // skip: ROR A
+  0x66, 0x22,        // ROR $22
+  0xCA,              // DEX
+  0xD0, 0xF3,        // BNE loop
+  0x85, 0x23,        // STA $23
+};
+
+// Copy four pages from $0400 to $0800 through (zp),Y pointers.
+static const std::vector<uint8_t> MEMCPY = {
+  0xA9, 0x04,        // LDA #$04
+  0x85, 0x31,        // STA $31
+  0xA9, 0x08,        // LDA #$08
+  0x85, 0x33,        // STA $33
+  0xA2, 0x04,        // LDX #4
+  0xA0, 0x00,        // LDY #0
+  0xB1, 0x30,        // loop: LDA ($30),Y
+  0x91, 0x32,        // STA ($32),Y
+  0xC8,              // INY
+  0xD0, 0xF9,        // BNE loop
+  0xE6, 0x31,        // INC $31
+  0xE6, 0x33,        // INC $33
+  0xCA,              // DEX
+  0xD0, 0xF2,        // BNE loop
+};
+
+// 16-bit decimal counters, one counting up by 1 and one down by 7.
+static const std::vector<uint8_t> DECIMAL = {
+  0xF8,              // SED
+  0x18,              // CLC
+  0xA5, 0x20,        // LDA $20
+  0x69, 0x01,        // ADC #$01
+  0x85, 0x20,        // STA $20
+  0xA5, 0x21,        // LDA $21
+  0x69, 0x00,        // ADC #$00
+  0x85, 0x21,        // STA $21
+  0x38,              // SEC
+  0xA5, 0x22,        // LDA $22
+  0xE9, 0x07,        // SBC #$07
+  0x85, 0x22,        // STA $22
+  0xA5, 0x23,        // LDA $23
+  0xE9, 0x00,        // SBC #$00
+  0x85, 0x23,        // STA $23
+  0xD8,              // CLD
+};
+
+// Eight rounds of an 8-bit LFSR seeded at $00, summing its states into $01
+// and counting the odd ones at $02, so lanes with other seeds branch apart.
+static const std::vector<uint8_t> SEEDED = {
+  0xA2, 0x08,        // LDX #8
+  0xA5, 0x00,        // loop: LDA $00
+  0x0A,              // ASL A
+  0x90, 0x02,        // BCC skip
+  0x49, 0x1D,        // EOR #$1D
+  0x85, 0x00,        // skip: STA $00
+  0x18,              // CLC
+  0x65, 0x01,        // ADC $01
+  0x85, 0x01,        // STA $01
+  0xA5, 0x00,        // LDA $00
+  0x4A,              // LSR A
+  0x90, 0x02,        // BCC even
+  0xE6, 0x02,        // INC $02
+  0xCA,              // even: DEX
+  0xD0, 0xE8,        // BNE loop
+};
+
+// Runs LANES copies of the program on mapped pages, lane n seeded with
+// n * 37 + 1 at $00: each on its own, then together in Lockstep, best of
+// the repeats. Figures are per lane-instruction, counted on a separate
+// stepped copy of each lane, and MHz is the lanes' cycles together.
+// Returns the share of lane-cycles Lockstep ran across groups.
+static double MeasureLockstep(const Options &options, const std::vector<uint8_t> &code, Result &alone, Result &grouped) {
+  Options mapped = options;
+  mapped.mapped = true;
+
+  const auto boot = [&](size_t lane) {
+    auto machine = Build(mapped, code);
+    machine->memory[0x00] = static_cast<uint8_t>(lane * 37 + 1);
+    return machine;
+  };
+
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  for (size_t lane = 0; lane < LANES; lane++) {
+    auto machine = boot(lane);
+    const uint64_t start = machine->Cycles();
+    while (machine->Cycles() - start < options.cycles) {
+      machine->Step();
+      instructions++;
+    }
+    cycles += machine->Cycles() - start;
+  }
+
+  double bestAlone = 1e30;
+  double bestGrouped = 1e30;
+  double vector = 0;
+  for (int repeat = 0; repeat < options.repeats; repeat++) {
+    std::unique_ptr<Flat> machines[LANES];
+    for (size_t lane = 0; lane < LANES; lane++) { machines[lane] = boot(lane); }
+    auto start = std::chrono::steady_clock::now();
+    for (auto &machine : machines) { machine->Run(options.cycles); }
+    bestAlone = std::min(bestAlone, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    std::array<Flat *, LANES> lanes;
+    for (size_t lane = 0; lane < LANES; lane++) {
+      machines[lane] = boot(lane);
+      lanes[lane] = machines[lane].get();
+    }
+    Lockstep<Flat, LANES> lockstep(lanes);
+    start = std::chrono::steady_clock::now();
+    lockstep.Run(options.cycles);
+    bestGrouped = std::min(bestGrouped, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    const auto &stats = lockstep.GetStats();
+    vector = static_cast<double>(stats.vectorCycles) / (stats.vectorCycles + stats.scalarCycles);
+  }
+
+  for (Result *result : { &alone, &grouped }) {
+    const double seconds = (result == &alone) ? bestAlone : bestGrouped;
+    result->cyclesPerInstruction = static_cast<double>(cycles) / instructions;
+    result->nsPerInstruction     = seconds * 1e9 / instructions;
+    result->mhz                  = cycles / seconds / 1e6;
+  }
+  return vector;
+}
+
+static void Print(const Result &result) {
+  std::printf("%-2s %-10s %-8s %-7s %6.2f %8.2f %9.1f\n", result.opcode.c_str(), result.name.c_str(), result.kind.c_str(),
+              result.mode.c_str(), result.cyclesPerInstruction, result.nsPerInstruction, result.mhz);
+}
+
+int main(int argc, char **argv) {
+  Options options;
+
+  for (int arg = 1; arg < argc; arg++) {
+    if (!std::strcmp(argv[arg], "--mapped")) {
+      options.mapped = true;
+    } else if (!std::strcmp(argv[arg], "--cycles") && arg + 1 < argc) {
+      options.cycles = std::strtoull(argv[++arg], nullptr, 0);
+    } else if (!std::strcmp(argv[arg], "--repeats") && arg + 1 < argc) {
+      options.repeats = std::max(1, std::atoi(argv[++arg]));
+    } else if (!std::strcmp(argv[arg], "--csv") && arg + 1 < argc) {
+      options.csv = argv[++arg];
+    } else {
+      std::printf("USAGE: %s [--mapped] [--cycles N] [--repeats N] [--csv results.csv]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::printf("bus: %s, %llu cycles per test, best of %d\n\n", options.mapped ? "mapped" : "Load/Store",
+              static_cast<unsigned long long>(options.cycles), options.repeats);
+  std::printf("%-2s %-10s %-8s %-7s %6s %8s %9s\n", "op", "name", "kind", "mode", "cyc", "ns/inst", "MHz");
+
+  std::vector<Result> results;
+
+  for (int opcode = 0; opcode < 0x100; opcode++) {
+    std::vector<uint8_t> code;
+    std::string name;
+    if (!Sequence(static_cast<uint8_t>(opcode), code, name)) { continue; }
+
+    char hex[3];
+    std::snprintf(hex, sizeof(hex), "%02X", opcode);
+
+    const OpcodeInfo &info = OPCODE_INFO[opcode];
+    Result result = Measure(options, code);
+    result.opcode = hex;
+    result.name = name;
+    result.kind = KIND_NAMES[info.kind];
+    result.mode = MODE_NAMES[info.mode];
+    results.push_back(result);
+    Print(result);
+  }
+
+  std::printf("\n");
+
+  struct Workload { const char *name; const std::vector<uint8_t> &code; };
+  const Workload workloads[] = {
+    { "arithmetic", ARITHMETIC },
+    { "memcpy",     MEMCPY },
+    { "decimal",    DECIMAL },
+  };
+
+  for (const Workload &workload : workloads) {
+    for (bool cache : { false, true }) {
+      if (cache && !options.mapped) { continue; }  // the code cache needs mapped pages
+
+      Result result = Measure(options, workload.code, cache);
+      result.name = workload.name;
+      result.kind = "mixed";
+      result.mode = cache ? "cached" : "-";
+      results.push_back(result);
+      Print(result);
+    }
+  }
+
+  std::printf("\n%zu lanes, mapped, one after another and in Lockstep\n", LANES);
+  const Workload lockstepWorkloads[] = {
+    { "arithmetic", ARITHMETIC },
+    { "memcpy",     MEMCPY },
+    { "decimal",    DECIMAL },
+    { "seeded",     SEEDED },
+  };
+
+  for (const Workload &workload : lockstepWorkloads) {
+    Result alone, grouped;
+    const double vector = MeasureLockstep(options, workload.code, alone, grouped);
+    alone.name = grouped.name = workload.name;
+    alone.kind = grouped.kind = "lockstep";
+    alone.mode   = "alone";
+    grouped.mode = "grouped";
+    for (Result *result : { &alone, &grouped }) {
+      results.push_back(*result);
+      Print(*result);
+    }
+    std::printf("%-2s %-10s %-8s %-7s %6.2fx %7.0f%% grouped\n", "", workload.name, "lockstep", "speedup",
+                alone.nsPerInstruction / grouped.nsPerInstruction, vector * 100);
+  }
+
+  if (options.csv) {
+    FILE *file = std::fopen(options.csv, "w");
+    if (!file) {
+      std::printf("ERROR: Could not open '%s'\n", options.csv);
+      return 1;
+    }
+
+    std::fprintf(file, "opcode,name,kind,mode,bus,cycles_per_instruction,ns_per_instruction,mhz\n");
+    for (const Result &result : results) {
+      std::fprintf(file, "%s,%s,%s,%s,%s,%.3f,%.3f,%.2f\n", result.opcode.c_str(), result.name.c_str(),
+                   result.kind.c_str(), result.mode.c_str(),
+                   (options.mapped || result.kind == "lockstep") ? "mapped" : "callback", result.cyclesPerInstruction, result.nsPerInstruction, result.mhz);
+    }
+    std::fclose(file);
+  }
+
+  return 0;
+}
@@ -0,0 +1,136 @@
+//
+// console.h
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Buffered, non-blocking console output. The CPU thread appends text to a
+// preallocated ring with write(), which never locks, allocates or touches
+// stdio; a background thread drains the ring to the output file. When the
+// ring is full a message is dropped whole and counted, so a ROM that writes
+// faster than the output can keep up never stalls emulation and memory
+// stays bounded.
+//
+// Single producer: only one thread may call write() and flush().
+class ConsoleSink {
+
+public:
+
+  // Capacity is rounded up to a power of two.
+  explicit ConsoleSink(size_t capacity = 0x10000, FILE *file = stdout) : file(file) {
+    size_t size = 1;
+    while (size < capacity) { size <<= 1; }
+    ring.resize(size);
+    mask = size - 1;
+    drainer = std::thread([this] { drain(); });
+  }
+
+  // Drains whatever is left, then reports any drops.
+  ~ConsoleSink() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_one();
+    drainer.join();
+
+    if (const uint64_t bytes = droppedBytes.load(std::memory_order_relaxed)) {
+      std::fprintf(stderr, "console: dropped %llu bytes in %llu messages\n",
+        static_cast<unsigned long long>(bytes), static_cast<unsigned long long>(dropped()));
+    }
+  }
+
+  ConsoleSink(const ConsoleSink &) = delete;
+  ConsoleSink &operator=(const ConsoleSink &) = delete;
+
+  // Appends `size` bytes, or drops them all if the ring has no room.
+  // Returns whether they were kept.
+  bool write(const char *text, size_t size) {
+    const uint64_t position = head.load(std::memory_order_relaxed);
+    const uint64_t drained  = tail.load(std::memory_order_acquire);
+    if (size > ring.size() - (position - drained)) {
+      droppedMessages.fetch_add(1, std::memory_order_relaxed);
+      droppedBytes.fetch_add(size, std::memory_order_relaxed);
+      return false;
+    }
+
+    const size_t offset = static_cast<size_t>(position & mask);
+    const size_t first  = std::min(size, ring.size() - offset);
+    std::memcpy(&ring[offset], text, first);
+    std::memcpy(&ring[0], text + first, size - first);
+    head.store(position + size, std::memory_order_release);
+
+    // Only a write into an empty ring needs to wake the drainer; otherwise
+    // it is already busy and will see this one before it sleeps.
+    if (position == drained) { wake.notify_one(); }
+    return true;
+  }
+
+  bool write(const char *text) { return write(text, std::strlen(text)); }
+
+  // Waits until everything written so far has reached the file, e.g. at a
+  // frame boundary or before the process exits.
+  void flush() {
+    const uint64_t position = head.load(std::memory_order_relaxed);
+    while (tail.load(std::memory_order_acquire) < position) {
+      wake.notify_one();
+      std::this_thread::yield();
+    }
+  }
+
+  // Messages dropped because the ring was full.
+  uint64_t dropped() const { return droppedMessages.load(std::memory_order_relaxed); }
+
+private:
+
+  FILE *file;
+  std::vector<char> ring;
+  uint64_t mask = 0;
+
+  // Bytes ever written and drained; head - tail are waiting in the ring.
+  std::atomic<uint64_t> head = 0;
+  std::atomic<uint64_t> tail = 0;
+
+  std::atomic<uint64_t> droppedMessages = 0;
+  std::atomic<uint64_t> droppedBytes = 0;
+
+  // The drainer sleeps on this between writes. write() notifies without the
+  // lock, so a wakeup can be missed; the timeout bounds the delay that causes.
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+  std::thread drainer;
+
+  void drain() {
+    for (;;) {
+      const uint64_t position = tail.load(std::memory_order_relaxed);
+      const uint64_t end      = head.load(std::memory_order_acquire);
+
+      if (position == end) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (stopping && head.load(std::memory_order_acquire) == position) { return; }
+        wake.wait_for(lock, std::chrono::milliseconds(10));
+        continue;
+      }
+
+      const size_t offset = static_cast<size_t>(position & mask);
+      const size_t size   = static_cast<size_t>(std::min<uint64_t>(end - position, ring.size() - offset));
+      std::fwrite(&ring[offset], 1, size, file);
+      if (position + size == end) { std::fflush(file); }
+      tail.store(position + size, std::memory_order_release);
+    }
+  }
+
+};
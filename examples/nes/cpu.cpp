@@ -4,14 +4,26 @@
 //
 
 #include <cstdio>
+#include <cstring>
+#include "console.h"
 #include "cpu.h"
 
-CPU::CPU(int chrSize, uint8_t *chrData, int prgSize, uint8_t *prgData) {
-  enableBCD = false; // 2A03 has BCD disabled at silicon level
+CPU::CPU(int chrSize, const uint8_t *chrData, int prgSize, const uint8_t *prgData) {
   this->chrSize = chrSize;
   this->chrData = chrData;
   this->prgSize = prgSize;
   this->prgData = prgData;
+
+  // Internal RAM has no side effects; map it and its three mirrors directly.
+  for (uint16_t mirror = 0x0000; mirror < 0x2000; mirror += 0x0800) {
+    MapPages(mirror, 0x0800, ram.data(), ram.data());
+  }
+  updateBanks();
+
+  // Cartridge reads have no side effects, so loops that only poll RAM, PRG-RAM
+  // or PRG-ROM (such as a test ROM's final JMP *) can be fast-forwarded once
+  // setHeadless() turns idle skip on.
+  MarkIdempotent(0x6000, 0xA000);
 }
 
 // ---------------------------------------------------------------------------
@@ -27,26 +39,30 @@ CPU::CPU(int chrSize, uint8_t *chrData, int prgSize, uint8_t *prgData) {
 // ---------------------------------------------------------------------------
 
 uint8_t CPU::Load(uint16_t address, bool peek) {
+  if (const uint8_t *bank = readBanks[address >> 11]) {
+    return bank[address & 0x07FF];
+  }
+
   switch (address) {
     default: return 0x00;
-    case 0x0000 ... 0x1FFF: return ram[address & 0x07FF];
     case 0x2000 ... 0x3FFF: return chrLoad(address);
-    case 0x4020 ... 0xFFFF: return prgLoad(address);
   }
 }
 
 void CPU::Store(uint16_t address, uint8_t value) {
-  switch (address) {
-    default: break;
-    case 0x0000 ... 0x1FFF: ram[address & 0x07FF] = value; break;
-    case 0x2000 ... 0x3FFF: chrStore(address, value);      break;
-    case 0x4020 ... 0x5FFF: /* expansion — not implemented */ break;
-    case 0x6000 ... 0xFFFF:
-      prgStore(address, value);
-      // Test ROM console output lives in the PRG-RAM window ($6000–$6103).
-      if (address <= 0x6103) { consoleWrite(address, value); }
-      break;
+  if (uint8_t *bank = writeBanks[address >> 11]) {
+    bank[address & 0x07FF] = value;
+  } else {
+    switch (address) {
+      default: break;
+      case 0x2000 ... 0x3FFF: chrStore(address, value); break;
+      case 0x4020 ... 0x5FFF: /* expansion — not implemented */ break;
+      case 0x8000 ... 0xFFFF: prgStore(address, value); break;
+    }
   }
+
+  // Test ROM console output lives in the PRG-RAM window ($6000–$6103).
+  if (address >= 0x6000 && address <= 0x6103) { consoleWrite(address, value); }
 }
 
 // ---------------------------------------------------------------------------
@@ -58,19 +74,9 @@ void CPU::Store(uint16_t address, uint8_t value) {
 // ---------------------------------------------------------------------------
 
 uint8_t CPU::chrLoad(uint16_t address) {
-  // CHR bank mode selects either one 8 KiB bank (mode 0) or two 4 KiB banks (mode 1).
-  // The address is masked to $0000–$1FFF (the PPU CHR window) before banking.
-  if (!chrSize) {
-    return chrRam[address & 0x1FFF];
-  }
-
-  if (!controlRegister.chrBankMode) {
-    // 8 KiB mode: chrRegister[0] selects the bank; low bit is ignored.
-    return chrData[((chrRegister[0].chrBank & 0x1E) << 12) | (address & 0x1FFF)];
-  }
-
-  // 4 KiB mode: chrRegister[0] for $0000–$0FFF, chrRegister[1] for $1000–$1FFF.
-  return chrData[(chrRegister[(address >> 12) & 0x01].chrBank << 12) | (address & 0x0FFF)];
+  // The address is masked to $0000–$1FFF (the PPU CHR window); updateBanks()
+  // has already resolved the bank for each 4 KiB half.
+  return chrBanks[(address >> 12) & 0x01][address & 0x0FFF];
 }
 
 void CPU::chrStore(uint16_t address, uint8_t value) {
@@ -81,68 +87,27 @@ void CPU::chrStore(uint16_t address, uint8_t value) {
 }
 
 // ---------------------------------------------------------------------------
-// PRG: cartridge ROM/RAM access ($4020–$FFFF)
+// PRG: MMC1 serial port writes ($8000–$FFFF)
+//
+// PRG-ROM reads and PRG-RAM reads and writes go through the bank tables.
 // ---------------------------------------------------------------------------
 
-uint8_t CPU::prgLoad(uint16_t address) {
-  switch (address) {
-    default: return 0x00;
-
-    case 0x6000 ... 0x7FFF:
-      return prgRegister.prgRamDisabled ? 0x00 : prgRam[address & 0x1FFF];
-
-    case 0x8000 ... 0xFFFF:
-      switch (controlRegister.prgBankMode) {
-        default: return 0x00;
-
-        case 0x00 ... 0x01:
-          // 32 KiB mode: prgRegister selects a 32 KiB block; low bit ignored.
-          return prgData[((prgRegister.prgBank & 0x1E) << 14) | (address & 0x7FFF)];
-
-        case 0x02:
-          // Fix-low mode: $8000–$BFFF is fixed to bank 0; $C000–$FFFF is switchable.
-          if (address <= 0xBFFF) {
-            return prgData[address & 0x3FFF];
-          }
-          return prgData[(prgRegister.prgBank << 14) | (address & 0x3FFF)];
-
-        case 0x03:
-          // Fix-high mode: $8000–$BFFF is switchable; $C000–$FFFF is fixed to last bank.
-          if (address <= 0xBFFF) {
-            return prgData[(prgRegister.prgBank << 14) | (address & 0x3FFF)];
-          }
-          return prgData[(prgSize - 0x4000) | (address & 0x3FFF)];
-      }
-  }
-}
-
 void CPU::prgStore(uint16_t address, uint8_t value) {
-  switch (address) {
+  loadRegister.d = value;
 
-    case 0x6000 ... 0x7FFF:
-      if (!prgRegister.prgRamDisabled) {
-        prgRam[address & 0x1FFF] = value;
-      }
-      break;
+  if (loadRegister.reset) {
+    // A write with bit 7 set resets the shift register and restores
+    // prgBankMode to 3 (fix-high) in the control register.
+    mmc1Write(0x8000, controlRegister.d | 0x0C);
+    shiftRegister.d = 0x00;
+  } else {
+    // Shift the data bit in LSB-first.
+    shiftRegister.value |= loadRegister.value << shiftRegister.writes++;
 
-    case 0x8000 ... 0xFFFF:
-      loadRegister.d = value;
-
-      if (loadRegister.reset) {
-        // A write with bit 7 set resets the shift register and restores
-        // prgBankMode to 3 (fix-high) in the control register.
-        mmc1Write(0x8000, controlRegister.d | 0x0C);
-        shiftRegister.d = 0x00;
-      } else {
-        // Shift the data bit in LSB-first.
-        shiftRegister.value |= loadRegister.value << shiftRegister.writes++;
-
-        if (shiftRegister.writes == 5) {
-          mmc1Write(address, shiftRegister.value);
-          shiftRegister.d = 0x00;
-        }
-      }
-      break;
+    if (shiftRegister.writes == 5) {
+      mmc1Write(address, shiftRegister.value);
+      shiftRegister.d = 0x00;
+    }
   }
 }
 
@@ -157,6 +122,84 @@ void CPU::mmc1Write(uint16_t address, uint8_t value) {
     case 0xC000 ... 0xDFFF: chrRegister[1].d  = value; break;
     case 0xE000 ... 0xFFFF: prgRegister.d     = value; break;
   }
+  updateBanks();
+}
+
+// ---------------------------------------------------------------------------
+// Bank tables
+//
+// Resolves the MMC1 registers to host pointers once per register write,
+// rather than on every access.
+// ---------------------------------------------------------------------------
+
+void CPU::updateBanks() {
+  // PRG-ROM: two 16 KiB windows at $8000 and $C000.
+  const int prgBanks = prgSize / 0x4000;
+  int low = 0, high = 0;
+  switch (controlRegister.prgBankMode) {
+    case 0x00 ... 0x01:
+      // 32 KiB mode: prgRegister selects a 32 KiB block; low bit ignored.
+      low  = prgRegister.prgBank & 0x0E;
+      high = low + 1;
+      break;
+    case 0x02:
+      // Fix-low mode: $8000–$BFFF is fixed to bank 0; $C000–$FFFF is switchable.
+      low  = 0;
+      high = prgRegister.prgBank;
+      break;
+    case 0x03:
+      // Fix-high mode: $8000–$BFFF is switchable; $C000–$FFFF is fixed to last bank.
+      low  = prgRegister.prgBank;
+      high = prgBanks - 1;
+      break;
+  }
+  const uint8_t *prgLow  = prgData + (low  % prgBanks) * 0x4000;
+  const uint8_t *prgHigh = prgData + (high % prgBanks) * 0x4000;
+
+  // PRG-RAM at $6000–$7FFF reads as 0x00 and ignores writes while disabled.
+  uint8_t *prgRamBank = prgRegister.prgRamDisabled ? nullptr : prgRam.data();
+
+  // CHR: one 8 KiB bank (mode 0, low bit ignored) or two 4 KiB banks (mode 1).
+  if (!chrSize) {
+    chrBanks = { chrRam.data(), chrRam.data() + 0x1000 };
+  } else if (!controlRegister.chrBankMode) {
+    const uint8_t *bank = chrData + (((chrRegister[0].chrBank & 0x1E) << 12) % chrSize);
+    chrBanks = { bank, bank + 0x1000 };
+  } else {
+    chrBanks = { chrData + ((chrRegister[0].chrBank << 12) % chrSize),
+                 chrData + ((chrRegister[1].chrBank << 12) % chrSize) };
+  }
+
+  for (int slot = 0; slot < 32; slot++) {
+    const int offset = (slot & 0x07) * 0x0800;
+    switch (slot) {
+      default:          readBanks[slot] = writeBanks[slot] = nullptr; break;
+      case 0x00 ... 0x03: readBanks[slot] = writeBanks[slot] = ram.data(); break;
+      case 0x0C ... 0x0F:
+        writeBanks[slot] = prgRamBank ? prgRamBank + (offset & 0x1FFF) : nullptr;
+        readBanks[slot]  = writeBanks[slot];
+        break;
+      case 0x10 ... 0x17: readBanks[slot] = prgLow  + offset; writeBanks[slot] = nullptr; break;
+      case 0x18 ... 0x1F: readBanks[slot] = prgHigh + offset; writeBanks[slot] = nullptr; break;
+    }
+  }
+
+  // Mirror the cartridge windows into the core's page table, so they bypass
+  // Load/Store entirely. Writes to PRG-ROM stay on the bus for the mapper,
+  // and so do writes to $6000–$61FF, for the test ROM console.
+  if (mappedWindows[0] != prgRamBank) {
+    MapPages(0x6000, 0x2000, prgRamBank, prgRamBank);
+    if (prgRamBank) { MapPages(0x6000, 0x0200, prgRamBank, nullptr); }
+    mappedWindows[0] = prgRamBank;
+  }
+  if (mappedWindows[1] != prgLow) {
+    MapPages(0x8000, 0x4000, prgLow, nullptr);
+    mappedWindows[1] = prgLow;
+  }
+  if (mappedWindows[2] != prgHigh) {
+    MapPages(0xC000, 0x4000, prgHigh, nullptr);
+    mappedWindows[2] = prgHigh;
+  }
 }
 
 // ---------------------------------------------------------------------------
@@ -164,22 +207,37 @@ void CPU::mmc1Write(uint16_t address, uint8_t value) {
 //
 // Follows the blargg/nestest convention:
 //   $6000        — status byte (0x00 = all tests passed, 0x80 = running)
-//   $6001–$6003  — unused
+//   $6001–$6003  — signature $DE $B0 $61, once the status byte is valid
 //   $6004–$6103  — null-terminated result string (256 bytes)
 //
 // The buffer is printed each time a new string starts (address wraps to
-// $6004) and when the status byte signals completion (value == 0x00).
+// $6004) and when the status byte signals completion (value == 0x00),
+// through the ConsoleSink when one is set, so the CPU thread never blocks
+// on stdio.
 // ---------------------------------------------------------------------------
 
 void CPU::consoleWrite(uint16_t address, uint8_t value) {
+  if (headless) {
+    if (address != 0x6000 || testStatus() < 0) { return; }
+
+    if (value == 0x81) {
+      // Reset no sooner than 100 ms later, as a person pressing it would.
+      Schedule(Cycles() + 1789773 / 10, [this] { Reset(); });
+    } else if (value != 0x80) {
+      Halt();
+    }
+    return;
+  }
+
   switch (address) {
 
     case 0x6000:
       if (value != 0x80) {
-        std::printf("Status: %02X\n", value);
+        char status[16];
+        consolePrint(status, std::snprintf(status, sizeof(status), "Status: %02X\n", value));
       }
       if (value == 0x00) {
-        std::printf("%s", consoleOutput.data());
+        consolePrint(consoleOutput.data(), consoleOutput.size());
       }
       break;
 
@@ -187,7 +245,7 @@ void CPU::consoleWrite(uint16_t address, uint8_t value) {
       const int index = address - 0x6004;
       // Flush the previous message when the write pointer wraps back to the start.
       if (index == 0) {
-        std::printf("%s", consoleOutput.data());
+        consolePrint(consoleOutput.data(), consoleOutput.size());
       }
       consoleOutput[index] = static_cast<char>(value);
       break;
@@ -195,3 +253,80 @@ void CPU::consoleWrite(uint16_t address, uint8_t value) {
 
   }
 }
+
+// Writes `text` up to its first NUL, or `size` bytes.
+void CPU::consolePrint(const char *text, size_t size) {
+  if (const void *end = std::memchr(text, 0, size)) {
+    size = static_cast<const char *>(end) - text;
+  }
+  if (!size) { return; }
+
+  if (console) {
+    console->write(text, size);
+  } else {
+    std::fwrite(text, 1, size, stdout);
+  }
+}
+
+int CPU::testStatus() const {
+  if (prgRam[1] != 0xDE || prgRam[2] != 0xB0 || prgRam[3] != 0x61) { return -1; }
+  return prgRam[0];
+}
+
+std::string CPU::testOutput() const {
+  const char *text = reinterpret_cast<const char *>(prgRam.data() + 4);
+  const size_t size = prgRam.size() - 4;
+  const void *end = std::memchr(text, 0, size);
+  return std::string(text, end ? static_cast<const char *>(end) - text : size);
+}
+
+// ---------------------------------------------------------------------------
+// Save states
+//
+// Appended after the MOS6502T state:
+//   version, control, chrRegister[0..1], prgRegister, shiftRegister,
+//   loadRegister, RAM, PRG-RAM, CHR-RAM
+// ---------------------------------------------------------------------------
+
+size_t CPU::SaveState(uint8_t *buffer, size_t size) const {
+  if (size < STATE_SIZE) { return 0; }
+
+  uint8_t *p = buffer + MOS6502T::SaveState(buffer, size);
+  *p++ = STATE_VERSION;
+  *p++ = controlRegister.d;
+  *p++ = chrRegister[0].d;
+  *p++ = chrRegister[1].d;
+  *p++ = prgRegister.d;
+  *p++ = shiftRegister.d;
+  *p++ = loadRegister.d;
+  std::memcpy(p, ram.data(),    ram.size());    p += ram.size();
+  std::memcpy(p, prgRam.data(), prgRam.size()); p += prgRam.size();
+  std::memcpy(p, chrRam.data(), chrRam.size());
+
+  return STATE_SIZE;
+}
+
+size_t CPU::LoadState(const uint8_t *buffer, size_t size) {
+  if (size < STATE_SIZE || buffer[MOS6502T::STATE_SIZE] != STATE_VERSION) { return 0; }
+  if (!MOS6502T::LoadState(buffer, size)) { return 0; }
+
+  const uint8_t *p = buffer + MOS6502T::STATE_SIZE + 1;
+  controlRegister.d = *p++;
+  chrRegister[0].d  = *p++;
+  chrRegister[1].d  = *p++;
+  prgRegister.d     = *p++;
+  shiftRegister.d   = *p++;
+  loadRegister.d    = *p++;
+  std::memcpy(ram.data(),    p, ram.size());    p += ram.size();
+  std::memcpy(prgRam.data(), p, prgRam.size()); p += prgRam.size();
+  std::memcpy(chrRam.data(), p, chrRam.size());
+  updateBanks();
+
+  return STATE_SIZE;
+}
+
+// ---------------------------------------------------------------------------
+// Instantiate the core here, after Load/Store, so they inline into dispatch.
+// ---------------------------------------------------------------------------
+
+template class MOS6502T<CPU, Ricoh2A03Official>;
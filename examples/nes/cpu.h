@@ -7,17 +7,53 @@
 
 #include <array>
 #include <cstdint>
-#include "MOS6502/MOS6502.h"
+#include <string>
+#include "MOS6502/MOS6502T.h"
 
-class CPU : public MOS6502 {
+class ConsoleSink;
+
+// Binds the bus statically so Load/Store inline into the dispatch loop, and
+// fixes the 2A03 variant (no decimal mode, documented opcodes only) at
+// compile time.
+class CPU : public MOS6502T<CPU, Ricoh2A03Official> {
 
 public:
 
-  CPU(int chrSize, uint8_t *chrData, int prgSize, uint8_t *prgData);
+  // The ROM data is not copied and must outlive the CPU.
+  CPU(int chrSize, const uint8_t *chrData, int prgSize, const uint8_t *prgData);
+
+  // MOS6502T interface
+  uint8_t Load(uint16_t address, bool peek = false);
+  void Store(uint16_t address, uint8_t value);
+
+  // Save states: the MOS6502T state, then a version byte, the MMC1
+  // registers, RAM, PRG-RAM and CHR-RAM. PRG/CHR-ROM are not included.
+  static constexpr uint8_t STATE_VERSION = 1;
+  static constexpr size_t  STATE_SIZE    = MOS6502T::STATE_SIZE + 1 + 6 + 0x0800 + 0x2000 + 0x2000;
+
+  size_t SaveState(uint8_t *buffer, size_t size) const;
+  size_t LoadState(const uint8_t *buffer, size_t size);
+
+  // Headless test runs: console output is left in PRG-RAM rather than
+  // printed, Run() stops once the test ROM reports its final status, a ROM
+  // that asks to be reset is reset, and idle loops are fast-forwarded (the
+  // runner always gives Run() a cycle budget).
+  void setHeadless(bool headless) {
+    this->headless = headless;
+    EnableIdleSkip(headless);
+  }
 
-  // MOS6502 interface
-  uint8_t Load(uint16_t address, bool peek = false) override;
-  void Store(uint16_t address, uint8_t value) override;
+  // The test ROM status byte at $6000 (0x80 running, 0x81 reset wanted, any
+  // other value is the final result, 0x00 passed), or -1 until the ROM has
+  // written the $DE $B0 $61 signature at $6001–$6003.
+  int testStatus() const;
+
+  // The NUL-terminated result text at $6004.
+  std::string testOutput() const;
+
+  // Sends console output to `console` (see console.h) instead of printing it
+  // from inside Store(). Null restores direct printing.
+  void setConsole(ConsoleSink *console) { this->console = console; }
 
 protected:
 
@@ -29,11 +65,14 @@ protected:
   //
 
   int chrSize = 0;
-  uint8_t *chrData = nullptr;
+  const uint8_t *chrData = nullptr;
 
   // CHR-RAM: used when the cartridge has no CHR-ROM (chrSize == 0).
   std::array<uint8_t, 0x2000> chrRam = {};
 
+  // The two 4 KiB halves of the PPU's CHR window.
+  std::array<const uint8_t *, 2> chrBanks = {};
+
   uint8_t chrLoad(uint16_t address);
   void chrStore(uint16_t address, uint8_t value);
 
@@ -42,14 +81,31 @@ protected:
   //
 
   int prgSize = 0;
-  uint8_t *prgData = nullptr;
+  const uint8_t *prgData = nullptr;
 
   // PRG-RAM (battery-backed save RAM), $6000–$7FFF.
   std::array<uint8_t, 0x2000> prgRam = {};
 
-  uint8_t prgLoad(uint16_t address);
   void prgStore(uint16_t address, uint8_t value);
 
+  //
+  // Bank tables
+  //
+  // The whole CPU address space in 2 KiB slots, indexed by address >> 11, so
+  // RAM, PRG-RAM and PRG-ROM accesses are one table load and one byte load.
+  // Null slots go to the I/O, PPU and mapper decoding instead. Rebuilt by
+  // updateBanks() whenever the MMC1 registers change.
+  //
+
+  std::array<const uint8_t *, 32> readBanks = {};
+  std::array<uint8_t *, 32> writeBanks = {};
+
+  // What is currently mapped into the core's page table at $6000, $8000
+  // and $C000, so updateBanks() only remaps windows that changed.
+  std::array<const uint8_t *, 3> mappedWindows = {};
+
+  void updateBanks();
+
   //
   // MMC1 mapper registers
   //
@@ -109,6 +165,13 @@ protected:
 
   std::array<char, 0x100> consoleOutput = {};
 
+  bool headless = false;
+  ConsoleSink *console = nullptr;
+
+  void consolePrint(const char *text, size_t size);
+
   void consoleWrite(uint16_t address, uint8_t value);
 
 };
+
+extern template class MOS6502T<CPU, Ricoh2A03Official>;
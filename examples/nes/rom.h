@@ -0,0 +1,137 @@
+//
+// rom.h
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// iNES 1.0 ROM file header (16 bytes, no padding).
+// Reference: https://www.nesdev.org/wiki/INES
+struct iNESHeader {
+  uint8_t magic[4];   // Must be { 0x4E, 0x45, 0x53, 0x1A } ("NES\x1A")
+  uint8_t prgPages;   // Number of 16 KiB PRG-ROM banks
+  uint8_t chrPages;   // Number of  8 KiB CHR-ROM banks (0 = CHR-RAM)
+  uint8_t mapperLo;   // Flags 6: lower nibble of mapper number + mirroring/battery bits
+  uint8_t mapperHi;   // Flags 7: upper nibble of mapper number + VS/PlayChoice bits
+  uint8_t padding[8]; // Bytes 8–15: unused in iNES 1.0
+};
+
+static_assert(sizeof(iNESHeader) == 16, "iNESHeader must be exactly 16 bytes");
+
+// The bytes of a ROM file. Where possible the file is mapped read-only and
+// the CPU reads PRG/CHR straight out of the mapping, so there is no copy and
+// every process running the same ROM shares it through the page cache.
+// Otherwise (Windows, or a file that cannot be mapped) it is read into memory.
+struct ROMFile {
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+
+  std::vector<uint8_t> buffer;
+#if !defined(_WIN32)
+  void *mapping = MAP_FAILED;
+  size_t mappingSize = 0;
+#endif
+
+  ROMFile() = default;
+  ROMFile(const ROMFile &) = delete;
+  ROMFile &operator=(const ROMFile &) = delete;
+
+  ~ROMFile() {
+#if !defined(_WIN32)
+    if (mapping != MAP_FAILED) { munmap(mapping, mappingSize); }
+#endif
+  }
+
+  bool open(const char *filename) {
+#if !defined(_WIN32)
+    const int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) { return false; }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+      mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping != MAP_FAILED) {
+        data = static_cast<const uint8_t *>(mapping);
+        size = mappingSize = static_cast<size_t>(info.st_size);
+      }
+    }
+    ::close(fd);
+    if (data) { return true; }
+#endif
+
+    // Open in binary mode — "r" (text mode) corrupts ROM data on Windows.
+    FILE *romFile = std::fopen(filename, "rb");
+    if (!romFile) { return false; }
+
+    uint8_t chunk[0x4000];
+    for (size_t count; (count = std::fread(chunk, 1, sizeof(chunk), romFile)) > 0; ) {
+      buffer.insert(buffer.end(), chunk, chunk + count);
+    }
+    std::fclose(romFile);
+
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+  }
+
+  // Pads a truncated file with zeros up to `wanted` bytes. The mapping can't
+  // be read past the end of the file, so this falls back to a copy.
+  void pad(size_t wanted) {
+    if (size >= wanted) { return; }
+    if (buffer.empty()) { buffer.assign(data, data + size); }
+    buffer.resize(wanted, 0x00);
+    data = buffer.data();
+    size = wanted;
+  }
+};
+
+// Where PRG and CHR are within a loaded ROM file.
+struct Cartridge {
+  int prgSize = 0;
+  const uint8_t *prgData = nullptr;
+  int chrSize = 0;  // 0 = CHR-RAM
+  const uint8_t *chrData = nullptr;
+};
+
+// Opens and checks an iNES file. Returns an empty string on success, or why it
+// could not be used; `rom` must outlive anything given `cartridge`'s pointers.
+inline std::string loadROM(const char *filename, ROMFile &rom, Cartridge &cartridge) {
+  const std::string quoted = std::string("'") + filename + "'";
+  if (!rom.open(filename)) { return "Could not open " + quoted; }
+
+  iNESHeader header;
+  if (rom.size < sizeof(iNESHeader)) { return "Could not read iNES header from " + quoted; }
+  std::memcpy(&header, rom.data, sizeof(iNESHeader));
+
+  // Validate the iNES magic number.
+  const uint8_t magic[4] = { 0x4E, 0x45, 0x53, 0x1A };
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0) { return quoted + " is not a valid iNES ROM file"; }
+
+  // PRG-ROM follows the header, then CHR-ROM (zero pages indicates CHR-RAM).
+  // As with a short fread, a file cut off after at least one whole bank of
+  // each is accepted, with the missing bytes read as zero.
+  const int prgSize = header.prgPages * 0x4000;
+  const int chrSize = header.chrPages * 0x2000;
+  const size_t prgOffset = sizeof(iNESHeader);
+  const size_t chrOffset = prgOffset + prgSize;
+
+  if (!prgSize || rom.size < prgOffset + 0x4000) { return "Could not read PRG-ROM data"; }
+  if (chrSize && rom.size < chrOffset + 0x2000) { return "Could not read CHR-ROM data"; }
+  rom.pad(chrOffset + chrSize);
+
+  cartridge = { prgSize, rom.data + prgOffset, chrSize, rom.data + chrOffset };
+  return {};
+}
@@ -0,0 +1,239 @@
+//
+// runner.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+// Headless test ROM runner. Runs single ROMs, every .nes file under a
+// directory, or the ROMs listed in a manifest, across all cores, and
+// reports each ROM's blargg result, emulated cycles and wall time.
+//
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "MOS6502/BatchRunner.h"
+#include "cpu.h"
+#include "rom.h"
+
+namespace fs = std::filesystem;
+
+// A worker's machine. The CPU's cartridge is fixed at construction, so each
+// job builds its own.
+struct TestMachine {
+  std::unique_ptr<ROMFile> rom;
+  std::unique_ptr<CPU> cpu;
+
+  uint64_t Run(uint64_t cycles) { return cpu ? cpu->Run(cycles) : 0; }
+};
+
+struct TestResult {
+  std::string error;
+  int status = -1;
+  std::string output;
+};
+
+static bool hasROMExtension(const fs::path &path) {
+  std::string extension = path.extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+  return extension == ".nes";
+}
+
+// A file named *.nes, or one starting with the iNES magic, is a single ROM.
+static bool isROM(const fs::path &path) {
+  if (hasROMExtension(path)) { return true; }
+
+  char magic[4] = {};
+  std::ifstream file(path, std::ios::binary);
+  return file.read(magic, sizeof(magic)) && !std::memcmp(magic, "NES\x1A", sizeof(magic));
+}
+
+// Adds every .nes file under `directory`, in name order. Returns false,
+// adding nothing, and says why if the directory cannot be walked.
+static bool collectDirectory(const fs::path &directory, std::vector<std::string> &paths) {
+  std::vector<std::string> found;
+  std::error_code error;
+  fs::recursive_directory_iterator entry(directory, error), end;
+  for (; !error && entry != end; entry.increment(error)) {
+    std::error_code ignored;
+    if (entry->is_regular_file(ignored) && hasROMExtension(entry->path())) { found.push_back(entry->path().string()); }
+  }
+  if (error) {
+    std::printf("ERROR: Cannot read '%s': %s\n", directory.string().c_str(), error.message().c_str());
+    return false;
+  }
+  std::sort(found.begin(), found.end());
+  paths.insert(paths.end(), found.begin(), found.end());
+  return true;
+}
+
+// Adds each line of `manifest` as a ROM path, relative to the manifest.
+// Blank lines and lines starting with '#' are skipped. Returns false, adding
+// nothing, if the file cannot be read, is not text, or names anything that
+// neither exists nor is a .nes file.
+static bool collectManifest(const fs::path &manifest, std::vector<std::string> &paths) {
+  std::ifstream file(manifest, std::ios::binary);
+  if (!file) { return false; }
+
+  const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  const bool binary = std::any_of(text.begin(), text.end(), [](unsigned char c) {
+    return c < 0x20 && c != '\t' && c != '\n' && c != '\r';
+  });
+  if (binary) { return false; }
+
+  std::vector<std::string> listed;
+  std::istringstream lines(text);
+  for (std::string line; std::getline(lines, line); ) {
+    line.erase(0, line.find_first_not_of(" \t"));
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (line.empty() || line[0] == '#') { continue; }
+
+    const fs::path path(line);
+    const fs::path resolved = path.is_absolute() ? path : manifest.parent_path() / path;
+    std::error_code error;
+    if (!fs::exists(resolved, error) && !hasROMExtension(resolved)) { return false; }
+    listed.push_back(resolved.string());
+  }
+  paths.insert(paths.end(), listed.begin(), listed.end());
+  return true;
+}
+
+// The message of an exception a job threw.
+static std::string describe(const std::exception_ptr &error) {
+  try {
+    std::rethrow_exception(error);
+  } catch (const std::exception &exception) {
+    return exception.what();
+  } catch (...) {
+    return "Unknown exception";
+  }
+}
+
+int main(int argc, char **argv) {
+
+  uint64_t cycles  = 1000000000;  // about nine minutes of NES time
+  unsigned threads = 0;
+  std::vector<std::string> paths;
+  bool usage = (argc < 2);
+
+  for (int arg = 1; arg < argc && !usage; arg++) {
+    std::error_code error;
+    const fs::file_status status = argv[arg][0] == '-' ? fs::file_status() : fs::status(argv[arg], error);
+
+    if (!std::strcmp(argv[arg], "--cycles") && arg + 1 < argc) {
+      cycles = std::strtoull(argv[++arg], nullptr, 0);
+    } else if (!std::strcmp(argv[arg], "--threads") && arg + 1 < argc) {
+      threads = static_cast<unsigned>(std::atoi(argv[++arg]));
+    } else if (argv[arg][0] == '-') {
+      usage = true;
+    } else if (error && error != std::errc::no_such_file_or_directory) {
+      std::printf("ERROR: Cannot read '%s': %s\n", argv[arg], error.message().c_str());
+      usage = true;
+    } else if (fs::is_directory(status)) {
+      usage = !collectDirectory(argv[arg], paths);
+    } else if (fs::is_regular_file(status) && isROM(argv[arg])) {
+      paths.push_back(argv[arg]);
+    } else if (!fs::is_regular_file(status) || !collectManifest(argv[arg], paths)) {
+      std::printf("ERROR: '%s' is not a directory, a .nes ROM or a manifest of ROMs\n", argv[arg]);
+      usage = true;
+    }
+  }
+
+  if (usage) {
+    std::printf("USAGE: %s [--cycles N] [--threads N] <directory | rom.nes | manifest>...\n", argv[0]);
+    return 1;
+  }
+
+  if (paths.empty()) {
+    std::printf("ERROR: No ROMs found\n");
+    return 1;
+  }
+
+  // ROMs are opened inside the jobs, so loading is spread across the pool
+  // too, and each is unmapped as soon as its run is over.
+  std::vector<TestResult> results(paths.size());
+  std::vector<BatchRunner<TestMachine>::Job> jobs(paths.size());
+
+  for (size_t index = 0; index < paths.size(); index++) {
+    jobs[index].cycles = cycles;
+
+    jobs[index].setup = [&, index](TestMachine &machine) {
+      Cartridge cartridge;
+      machine.rom = std::make_unique<ROMFile>();
+      results[index].error = loadROM(paths[index].c_str(), *machine.rom, cartridge);
+      if (!results[index].error.empty()) { return; }
+
+      machine.cpu = std::make_unique<CPU>(cartridge.chrSize, cartridge.chrData, cartridge.prgSize, cartridge.prgData);
+      machine.cpu->setHeadless(true);
+      machine.cpu->Reset();
+    };
+
+    jobs[index].finish = [&, index](TestMachine &machine) {
+      if (machine.cpu) {
+        results[index].status = machine.cpu->testStatus();
+        results[index].output = machine.cpu->testOutput();
+      }
+      machine.cpu.reset();
+      machine.rom.reset();
+    };
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  BatchRunner<TestMachine> runner([] { return std::make_unique<TestMachine>(); }, threads);
+  const std::vector<BatchRunner<TestMachine>::Result> runs = runner.Run(jobs);
+  const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  size_t passed = 0, failed = 0, timedOut = 0, errors = 0;
+
+  for (size_t index = 0; index < paths.size(); index++) {
+    const TestResult &result = results[index];
+    const double seconds = std::chrono::duration<double>(runs[index].time).count();
+    const std::string error = runs[index].error ? describe(runs[index].error) : result.error;
+
+    char verdict[16];
+    if (!error.empty()) {
+      std::snprintf(verdict, sizeof(verdict), "ERROR");
+      errors++;
+    } else if (result.status == 0x00) {
+      std::snprintf(verdict, sizeof(verdict), "PASS");
+      passed++;
+    } else if (result.status > 0x00 && result.status != 0x80 && result.status != 0x81) {
+      std::snprintf(verdict, sizeof(verdict), "FAIL %02X", result.status);
+      failed++;
+    } else {
+      std::snprintf(verdict, sizeof(verdict), "TIMEOUT");
+      timedOut++;
+    }
+
+    std::printf("%-8s %14" PRIu64 " cycles %9.3f s  %s\n", verdict, runs[index].cycles, seconds, paths[index].c_str());
+
+    if (!error.empty()) {
+      std::printf("         %s\n", error.c_str());
+    } else if (result.status != 0x00 && !result.output.empty()) {
+      // Indent the ROM's own report under its line.
+      std::string text = result.output;
+      while (!text.empty() && text.back() == '\n') { text.pop_back(); }
+      for (size_t line = 0; line != std::string::npos; ) {
+        const size_t end = text.find('\n', line);
+        std::printf("         %s\n", text.substr(line, end - line).c_str());
+        line = (end == std::string::npos) ? end : end + 1;
+      }
+    }
+  }
+
+  std::printf("\n%zu passed, %zu failed, %zu timed out, %zu errors, %zu ROMs in %.3f s\n",
+    passed, failed, timedOut, errors, paths.size(), wall);
+
+  return (passed == paths.size()) ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+//
+// Alu.h
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+#include <cstdint>
+
+//
+// Pure arithmetic, compare and shift math shared by the scalar core and the
+// Lockstep lanes. Each helper takes the operands and the flags it reads and
+// returns the result, the carry out and the overflow out as 0 or 1. N and Z
+// come from the value itself, so callers only need to store it.
+//
+// The only branch is the decimal adjustment in ADC/SBC, kept so the scalar
+// core skips it in binary mode; it is a pair of conditional adds that the
+// compiler if-converts when the helper is inlined into a lane loop.
+//
+
+struct AluResult {
+  uint8_t value;
+  uint8_t carry;
+  uint8_t overflow;
+};
+
+static constexpr AluResult AdcResult(uint8_t a, uint8_t input, uint8_t carry, bool decimal) {
+  uint16_t temp = a + input + carry;
+  const uint8_t overflow = (~(a ^ input) & (a ^ temp) & 0x80) ? 1 : 0;
+
+  if (decimal) {
+    if ((temp & 0x00F) > 0x09) { temp += 0x06; }
+    if ((temp & 0xFF0) > 0x90) { temp += 0x60; }
+  }
+
+  return { static_cast<uint8_t>(temp & 0xFF), static_cast<uint8_t>((temp >> 8) & 1), overflow };
+}
+
+static constexpr AluResult SbcResult(uint8_t a, uint8_t input, uint8_t carry, bool decimal) {
+  return AdcResult(a, static_cast<uint8_t>(~input), carry, decimal);
+}
+
+static constexpr AluResult CmpResult(uint8_t reg, uint8_t input) {
+  return { static_cast<uint8_t>(reg - input), static_cast<uint8_t>(reg >= input ? 1 : 0), 0 };
+}
+
+static constexpr AluResult AslResult(uint8_t input) {
+  return { static_cast<uint8_t>(input << 1), static_cast<uint8_t>(input >> 7), 0 };
+}
+
+static constexpr AluResult LsrResult(uint8_t input) {
+  return { static_cast<uint8_t>(input >> 1), static_cast<uint8_t>(input & 0x01), 0 };
+}
+
+static constexpr AluResult RolResult(uint8_t input, uint8_t carry) {
+  return { static_cast<uint8_t>((input << 1) | carry), static_cast<uint8_t>(input >> 7), 0 };
+}
+
+static constexpr AluResult RorResult(uint8_t input, uint8_t carry) {
+  return { static_cast<uint8_t>((input >> 1) | (carry << 7)), static_cast<uint8_t>(input & 0x01), 0 };
+}
@@ -0,0 +1,146 @@
+//
+// BatchRunner.h
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// Runs many independent, bounded CPU executions across a work-stealing
+// thread pool.
+//
+// Each worker owns one Machine (any MOS6502 or MOS6502T<...>-derived class)
+// built once by the factory and reused for every job it runs. A job's setup
+// callback puts that machine into the job's starting state (cartridge, save
+// state, inputs, Reset()); the runner then calls Run(cycles) and the job's
+// finish callback collects whatever the caller needs. Immutable data such as
+// ROM images should be captured by pointer so every worker shares one copy.
+//
+// Jobs are dealt round-robin into per-worker queues. A worker takes from the
+// front of its own queue and, once empty, steals from the back of the others,
+// so uneven job lengths still keep every core busy.
+//
+// An exception thrown by a job's setup, Run() or finish, or by the factory,
+// is caught and stored in that job's Result; the rest of the batch still
+// runs. The worker then discards its machine, whose state is unknown, and
+// builds a fresh one for its next job.
+//
+
+template <typename Machine>
+class BatchRunner
+{
+
+public:
+
+  struct Job {
+    uint64_t cycles = 0;
+    std::function<void(Machine &)> setup;
+    std::function<void(Machine &)> finish;
+  };
+
+  struct Result {
+    uint64_t cycles = 0;              // cycles actually executed
+    std::chrono::nanoseconds time{};  // wall time of setup, run and finish
+    std::exception_ptr error;         // what the job threw, if anything
+  };
+
+  using Factory = std::function<std::unique_ptr<Machine>()>;
+
+  explicit BatchRunner(Factory factory, unsigned threads = 0)
+    : factory(std::move(factory)),
+      threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+  // Runs every job and returns their results in job order.
+  std::vector<Result> Run(const std::vector<Job> &jobs) {
+    std::vector<Result> results(jobs.size());
+
+    const unsigned workers = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(jobs.size(), 1)));
+    std::vector<Queue> queues(workers);
+    for (size_t index = 0; index < jobs.size(); index++) {
+      queues[index % workers].jobs.push_back(index);
+    }
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers);
+    for (unsigned worker = 0; worker < workers; worker++) {
+      pool.emplace_back([&, worker] { Work(worker, queues, jobs, results); });
+    }
+    for (std::thread &thread : pool) {
+      thread.join();
+    }
+
+    return results;
+  }
+
+private:
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<size_t> jobs;
+  };
+
+  Factory factory;
+  unsigned threads;
+
+  void Work(unsigned worker, std::vector<Queue> &queues, const std::vector<Job> &jobs, std::vector<Result> &results) {
+    std::unique_ptr<Machine> machine;
+
+    size_t index;
+    while (Take(worker, queues, index)) {
+      const Job &job = jobs[index];
+      Result &result = results[index];
+
+      auto start = std::chrono::steady_clock::now();
+      try {
+        if (!machine) {
+          machine = factory();
+          start   = std::chrono::steady_clock::now();
+        }
+        if (job.setup) { job.setup(*machine); }
+        result.cycles = machine->Run(job.cycles);
+        if (job.finish) { job.finish(*machine); }
+      } catch (...) {
+        result.error = std::current_exception();
+        machine.reset();
+      }
+      result.time = std::chrono::steady_clock::now() - start;
+    }
+  }
+
+  // No jobs are added once Run() starts, so one empty pass means we're done.
+  static bool Take(unsigned worker, std::vector<Queue> &queues, size_t &index) {
+    {
+      Queue &own = queues[worker];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.jobs.empty()) {
+        index = own.jobs.front();
+        own.jobs.pop_front();
+        return true;
+      }
+    }
+
+    for (size_t offset = 1; offset < queues.size(); offset++) {
+      Queue &victim = queues[(worker + offset) % queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.jobs.empty()) {
+        index = victim.jobs.back();
+        victim.jobs.pop_back();
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+};
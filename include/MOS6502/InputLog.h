@@ -0,0 +1,195 @@
+//
+// InputLog.h
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//
+// Everything from outside the CPU that steered one run, filled by
+// MOS6502T::Record() and played back by MOS6502T::Replay().
+//
+// Two streams are kept: the interrupts the CPU took, each as the cycle it was
+// taken at (a varint delta from the previous one) with the NMI/IRQ choice in
+// its low bit, and the byte returned by every read of an address marked
+// nondeterministic (controller ports, timers, anything the program reads
+// that is not a pure function of the CPU's own state). Recording the
+// interrupts taken rather than the raw line changes keeps the log exact even
+// when Signal() is called from other threads between instruction boundaries.
+//
+// A replay must start from the same machine state as the recording, e.g. a
+// SaveState() taken just before Record().
+//
+// Only reads that reach the bus can be logged. Reads of a page mapped with
+// MapPages() never leave the core, so marked addresses must stay unmapped
+// for as long as the log is in use; Record() and Replay() refuse a log that
+// marks a mapped page.
+//
+
+class InputLog
+{
+
+public:
+
+  enum INTERRUPT : uint8_t { NMI = 0, IRQ = 1 };
+
+  // Reads of [address, address + size) are recorded and replayed.
+  void MarkNondeterministic(uint16_t address, uint32_t size) {
+    for (uint32_t offset = 0; offset < size; offset++) {
+      const uint16_t marked = static_cast<uint16_t>(address + offset);
+      watched[marked >> 6] |= uint64_t(1) << (marked & 63);
+    }
+  }
+
+  bool IsNondeterministic(uint16_t address) const {
+    return (watched[address >> 6] >> (address & 63)) & 1;
+  }
+
+  // Whether any address in the 256-byte page is marked.
+  bool MarksPage(uint8_t page) const {
+    const size_t word = static_cast<size_t>(page) << 2;
+    return (watched[word] | watched[word + 1] | watched[word + 2] | watched[word + 3]) != 0;
+  }
+
+  // Empties both streams; the marked addresses are kept.
+  void Clear() {
+    interrupts.clear();
+    values.clear();
+    interruptCount = 0;
+    lastCycle = 0;
+    Rewind();
+  }
+
+  // Moves the replay position back to the start; Replay() does this itself.
+  void Rewind() {
+    interruptCursor = 0;
+    valueCursor     = 0;
+    replayCycle     = 0;
+    replayKind      = NMI;
+    Decode();
+  }
+
+  size_t Interrupts() const { return interruptCount; }
+  size_t Values() const { return values.size(); }
+
+  // True once every recorded interrupt and value has been replayed.
+  bool Finished() const { return replayCycle == UINT64_MAX && valueCursor == values.size(); }
+
+  // Serialised form: a header, the marked-address bitmap, then both streams.
+  std::vector<uint8_t> Save() const {
+    std::vector<uint8_t> data(HEADER_SIZE + sizeof(watched));
+    std::memcpy(data.data(), "M65I", 4);
+    Put32(&data[4],  static_cast<uint32_t>(interrupts.size()));
+    Put32(&data[8],  static_cast<uint32_t>(values.size()));
+    Put32(&data[12], static_cast<uint32_t>(interruptCount));
+    for (size_t word = 0; word < watched.size(); word++) {
+      for (int shift = 0; shift < 64; shift += 8) {
+        data[HEADER_SIZE + word * 8 + shift / 8] = static_cast<uint8_t>(watched[word] >> shift);
+      }
+    }
+    data.insert(data.end(), interrupts.begin(), interrupts.end());
+    data.insert(data.end(), values.begin(), values.end());
+    return data;
+  }
+
+  // Returns false, leaving the log unchanged, if `data` is not a saved log.
+  bool Load(const uint8_t *data, size_t size) {
+    if (size < HEADER_SIZE + sizeof(watched) || std::memcmp(data, "M65I", 4) != 0) { return false; }
+
+    const size_t interruptBytes = Get32(&data[4]);
+    const size_t valueBytes     = Get32(&data[8]);
+    if (size != HEADER_SIZE + sizeof(watched) + interruptBytes + valueBytes) { return false; }
+
+    for (size_t word = 0; word < watched.size(); word++) {
+      watched[word] = 0;
+      for (int shift = 0; shift < 64; shift += 8) {
+        watched[word] |= static_cast<uint64_t>(data[HEADER_SIZE + word * 8 + shift / 8]) << shift;
+      }
+    }
+
+    const uint8_t *streams = data + HEADER_SIZE + sizeof(watched);
+    interrupts.assign(streams, streams + interruptBytes);
+    values.assign(streams + interruptBytes, streams + interruptBytes + valueBytes);
+    interruptCount = Get32(&data[12]);
+    Rewind();
+    return true;
+  }
+
+private:
+
+  template <typename, typename> friend class MOS6502T;
+  template <typename, typename, bool> friend class MOS6502Core;
+
+  static constexpr size_t HEADER_SIZE = 16;
+
+  std::array<uint64_t, 0x10000 / 64> watched = {};
+
+  std::vector<uint8_t> interrupts;
+  std::vector<uint8_t> values;
+  size_t   interruptCount = 0;
+  uint64_t lastCycle = 0;
+
+  size_t    interruptCursor = 0;
+  size_t    valueCursor = 0;
+  uint64_t  replayCycle = UINT64_MAX;  // of the next interrupt to replay
+  INTERRUPT replayKind = NMI;
+
+  //
+  // Recording
+  //
+
+  void RecordInterrupt(uint64_t cycle, INTERRUPT kind) {
+    uint64_t word = ((cycle - lastCycle) << 1) | kind;
+    lastCycle = cycle;
+    while (word >= 0x80) {
+      interrupts.push_back(static_cast<uint8_t>(word | 0x80));
+      word >>= 7;
+    }
+    interrupts.push_back(static_cast<uint8_t>(word));
+    interruptCount++;
+  }
+
+  void RecordValue(uint8_t value) { values.push_back(value); }
+
+  //
+  // Replay
+  //
+
+  // Decodes the next interrupt into replayCycle and replayKind.
+  void Decode() {
+    if (interruptCursor == interrupts.size()) {
+      replayCycle = UINT64_MAX;
+      return;
+    }
+
+    uint64_t word = 0;
+    for (int shift = 0; interruptCursor < interrupts.size(); shift += 7) {
+      const uint8_t byte = interrupts[interruptCursor++];
+      word |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) { break; }
+    }
+    replayCycle += word >> 1;
+    replayKind   = static_cast<INTERRUPT>(word & 1);
+  }
+
+  // The next recorded value; false once the log runs out.
+  bool ReplayValue(uint8_t &value) {
+    if (valueCursor == values.size()) { return false; }
+    value = values[valueCursor++];
+    return true;
+  }
+
+  static void Put32(uint8_t *p, uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) { *p++ = static_cast<uint8_t>(value >> shift); }
+  }
+
+  static uint32_t Get32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+  }
+
+};
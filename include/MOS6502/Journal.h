@@ -0,0 +1,58 @@
+//
+// Journal.h
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//
+// Undo log of stores, filled by MOS6502T::SetJournal(). Every store that the
+// core makes through a mapped page appends its address and the byte it
+// replaced; Rewind (Rewind.h) plays them back newest first to return memory
+// to an earlier keyframe. Fixed size: once full, the oldest entries are
+// overwritten, and Count() - Capacity() is the oldest still held.
+//
+
+class StoreJournal
+{
+
+public:
+
+  struct Entry {
+    uint16_t address;
+    uint8_t  value;
+  };
+
+  // Capacity is rounded up to a power of two.
+  explicit StoreJournal(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) { size <<= 1; }
+    entries.resize(size);
+    mask = size - 1;
+  }
+
+  size_t Capacity() const { return entries.size(); }
+
+  // Entries appended since construction, including overwritten ones.
+  uint64_t Count() const { return head; }
+
+  inline void Append(uint16_t address, uint8_t value) {
+    entries[head++ & mask] = { address, value };
+  }
+
+  // Valid for Count() - Capacity() <= index < Count().
+  const Entry &At(uint64_t index) const { return entries[index & mask]; }
+
+  // Drops the entries from `count` on, once they have been played back.
+  void Truncate(uint64_t count) { head = count; }
+
+private:
+
+  std::vector<Entry> entries;
+  uint64_t mask = 0;
+  uint64_t head = 0;
+
+};
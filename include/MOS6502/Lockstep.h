@@ -0,0 +1,970 @@
+//
+// Lockstep.h
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "MOS6502/Alu.h"
+#include "MOS6502/MOS6502T.h"
+
+//
+// Runs LANES copies of the same program in lockstep.
+//
+// Each lane is an ordinary MOS6502T-derived machine with its own memory and
+// bus. While the lanes run, their registers are held here as a structure of
+// arrays. Every step picks a leader: the lane with the lowest PC among those
+// less than WINDOW cycles ahead of the slowest, so lanes that fell behind
+// catch up and reconverge, but none waits long on a lane looping below it.
+//
+// The lanes at the leader's PC form a group and run the instruction there
+// together: loads, stores, ALU and read-modify-write operations in every
+// addressing mode, register and flag operations, branches and JMP. Each lane
+// has its own operand bytes, read once per PC and kept until the lane's code
+// may have changed, and its own memory, through its mapped pages (see
+// MapPages). The register and flag updates, decimal ADC and SBC included,
+// run 32 lanes at a time, in AVX2 registers when the build enables it
+// (MOS6502_AVX2) and in SSE2 or plain loops otherwise. A group goes on from
+// one instruction to the next without choosing a leader again until it
+// splits at a branch or catches up with a waiting lane; after a split, the
+// members at the lower PC carry on. A lane runs the instruction on its own
+// core instead when it is anything else (stack operations, calls, returns,
+// BRK and JMP (abs)), touches an unmapped or watched page, or has an
+// interrupt, event, halt or breakpoint pending.
+//
+// A lane alone at the leader's PC runs on its own core in a burst until it
+// reaches a PC where another lane is waiting, its budget ends or it gets
+// WINDOW cycles ahead. Traced lanes and Profiled<> machines, which record
+// every instruction, only ever run in bursts. A burst runs as Run() does: on
+// a local core once pages are mapped, through the code cache when it is
+// enabled, and skipping idle loops when that is enabled.
+//
+// The group arithmetic matches the Alu.h helpers the scalar core uses, under
+// each lane's own variant setting, so every lane ends in the same state,
+// with the same cycle count, as if it had been run on its own. The lanes
+// must not share memory that the program writes.
+//
+
+template <typename Machine, size_t LANES>
+class Lockstep
+{
+
+public:
+
+  struct Stats {
+    uint64_t vectorCycles = 0;  // lane-cycles run across a group
+    uint64_t scalarCycles = 0;  // lane-cycles run on a lane's own core
+  };
+
+  // How many cycles a lane may get ahead of the slowest before it waits.
+  static constexpr uint64_t WINDOW = 1024;
+
+  explicit Lockstep(const std::array<Machine *, LANES> &lanes) : lanes(lanes) {}
+
+  // Runs every lane until it has executed at least `budget` cycles or halted.
+  void Run(uint64_t budget);
+
+  const Stats &GetStats() const { return stats; }
+
+private:
+
+  using Core = typename Machine::Core;
+
+  std::array<Machine *, LANES> lanes;
+
+  Stats stats;
+
+  // A profiled machine counts every instruction it executes, which a group
+  // step would skip.
+  static constexpr bool PROFILED = std::is_base_of_v<Profiler<true>, Machine>;
+
+  // Lanes are processed 32 at a time; the lanes past LANES stay out of every
+  // group.
+  static constexpr size_t WIDTH = (LANES + 31) / 32 * 32;
+  static_assert(LANES >= 1 && LANES <= 256, "lanes are numbered in a byte");
+
+  alignas(32) std::array<uint8_t, WIDTH> A = {}, X = {}, Y = {}, S = {}, P = {};
+  alignas(32) std::array<uint8_t, WIDTH> bcd   = {};  // FLAG_D if the lane honours P.D
+  alignas(32) std::array<uint8_t, WIDTH> group = {};  // 0xFF for lanes in this step's group
+  alignas(32) std::array<uint8_t, WIDTH> value = {};  // operand or memory value, then result
+
+  std::array<uint16_t, LANES> PC      = {};
+  std::array<uint16_t, LANES> address = {};  // effective address
+  std::array<uint8_t *, LANES> cell   = {};  // where a store to it lands
+
+  std::array<uint64_t, LANES> cycles = {};
+  std::array<uint64_t, LANES> end    = {};
+  std::array<uint64_t, LANES> due    = {};  // next event, as of the lane's last scalar run
+  std::array<uint8_t, LANES>  done   = {};  // 1 once the lane is out of budget or stopped
+  std::array<bool, LANES>     solo   = {};  // never joins a group
+  std::array<bool, LANES>     idle   = {};  // skips idle loops
+
+  // This step's group, and the members that have to run it on their own.
+  std::array<uint8_t, LANES> members = {};
+  std::array<uint8_t, LANES> apart   = {};
+  size_t memberCount = 0;
+  size_t apartCount  = 0;
+
+  // A group that ran whole and is still together goes on without choosing a
+  // leader again while it would be chosen again: its PC is below `fence`,
+  // the lowest PC of the other lanes that are or could become candidates,
+  // and it is not WINDOW cycles ahead of them (`reach`).
+  bool     intact = false;
+  uint32_t fence  = 0;
+  uint64_t reach  = 0;
+
+  // How many cycles every member can run before one reaches the end of its
+  // budget or its next event; Check() looks again when it runs out. And
+  // whether any member skips idle loops.
+  uint64_t headroom = 0;
+  bool     idling   = false;
+
+  // PCs of the lanes a burst stops at, one bit per address.
+  std::array<uint64_t, 0x10000 / 64> joins = {};
+
+  // P bits
+  static constexpr uint8_t FLAG_C = 0x01, FLAG_Z = 0x02, FLAG_I = 0x04, FLAG_D = 0x08;
+  static constexpr uint8_t FLAG_V = 0x40, FLAG_N = 0x80;
+
+  // What a group can run, by opcode. Everything else runs per lane.
+  enum Operation : uint8_t {
+    NONE,
+    LDA, LDX, LDY, STA, STX, STY,
+    ADC, SBC, AND, ORA, EOR, CMP, CPX, CPY, BIT,
+    INC, DEC, ASL, LSR, ROL, ROR,
+    TAX, TAY, TSX, TXA, TXS, TYA, INX, INY, DEX, DEY,
+    CLC, SEC, CLD, SED, CLI, SEI, CLV, NOP,
+    JMP, BRANCH,
+  };
+
+  static constexpr const char *NAMES[] = {
+    "",
+    "LDA", "LDX", "LDY", "STA", "STX", "STY",
+    "ADC", "SBC", "AND", "ORA", "EOR", "CMP", "CPX", "CPY", "BIT",
+    "INC", "DEC", "ASL", "LSR", "ROL", "ROR",
+    "TAX", "TAY", "TSX", "TXA", "TXS", "TYA", "INX", "INY", "DEX", "DEY",
+    "CLC", "SEC", "CLD", "SED", "CLI", "SEI", "CLV", "NOP",
+    "JMP",
+  };
+
+  static constexpr bool Named(const char *a, const char *b) {
+    while (*a && *a == *b) { a++; b++; }
+    return *a == *b;
+  }
+
+  // Official opcodes only, and not JMP (abs).
+  static constexpr std::array<Operation, 0x100> OPERATIONS = [] {
+    std::array<Operation, 0x100> table = {};
+    for (size_t opcode = 0; opcode < 0x100; opcode++) {
+      const OpcodeInfo &info = OPCODE_INFO[opcode];
+      if (info.kind != OpcodeInfo::OFFICIAL || info.mode == OpcodeInfo::IND) { continue; }
+      if (info.mode == OpcodeInfo::REL) { table[opcode] = BRANCH; continue; }
+      for (size_t name = 1; name < std::size(NAMES); name++) {
+        if (Named(info.mnemonic, NAMES[name])) { table[opcode] = static_cast<Operation>(name); }
+      }
+    }
+    return table;
+  }();
+
+  // The instruction at a PC, decoded for the group: its opcode, and the
+  // operand each lane read there, good for as long as the lane's epoch is
+  // the one recorded. A lane's epoch moves on whenever its code may have
+  // changed: when it runs on its own core, and when a group store lands in a
+  // page with decoded code. Entries are kept by the low byte of the PC.
+  struct Decoded {
+    alignas(32) std::array<uint8_t, WIDTH> low = {}, high = {};
+    std::array<uint32_t, LANES> epoch = {};
+    uint16_t  pc        = 0;
+    uint8_t   opcode    = 0;
+    Operation operation = NONE;
+    uint8_t   lowFirst  = 0;  // the operand of the first lane to decode it
+    uint8_t   highFirst = 0;
+    bool      uniform   = true;  // every lane since read that same operand
+  };
+
+  std::vector<Decoded>        decoded = std::vector<Decoded>(0x100);
+  std::array<uint32_t, LANES> epoch   = {};
+  std::array<bool, 0x100>     codePages = {};  // pages anything was decoded from
+
+  bool Step();
+  void Group(uint16_t pc);
+  void Check();
+  Decoded &Lookup(uint16_t pc);
+  bool Decode(Decoded &entry, size_t lane);
+  void Burst(size_t lane, bool join);
+  void Scalar(size_t lane, uint64_t limit, bool once, bool join);
+  template <typename LaneCore>
+  void Execute(Machine &machine, LaneCore &core, uint64_t limit, bool once, bool join);
+
+  void Gather(size_t lane);
+  void Scatter(size_t lane);
+
+  static uint64_t Ahead(uint64_t cycle) {
+    return (cycle > UINT64_MAX - WINDOW) ? UINT64_MAX : cycle + WINDOW;
+  }
+
+  bool Joins(uint16_t pc) const {
+    return (joins[pc >> 6] >> (pc & 63)) & 1;
+  }
+
+  // Drops a member from this step's group, to run the instruction on its own.
+  void Drop(size_t lane) {
+    group[lane] = 0x00;
+    apart[apartCount++] = static_cast<uint8_t>(lane);
+  }
+
+  template <OpcodeInfo::MODE MODE>
+  bool Fetch(const Decoded &entry, OpcodeInfo::EFFECT effect);
+  void Access(const Decoded &entry, uint16_t pc);
+  void Jump(const Decoded &entry, uint16_t pc);
+  void Settle(uint16_t next, uint8_t spent);
+  void Regroup();
+  void Operate(Operation operation, bool accumulator, const uint8_t *operand);
+
+  void Spend(uint64_t spent) {
+    headroom = (headroom > spent) ? headroom - spent : 0;
+  }
+
+  //
+  // 32 lanes of bytes: one AVX2 register when the build targets it, and an
+  // array the compiler vectorises otherwise.
+  //
+
+  struct Bytes {
+#if defined(__AVX2__)
+    __m256i v;
+
+    static Bytes Load(const uint8_t *p) { return { _mm256_load_si256(reinterpret_cast<const __m256i *>(p)) }; }
+    void Store(uint8_t *p) const { _mm256_store_si256(reinterpret_cast<__m256i *>(p), v); }
+    static Bytes Splat(uint8_t b) { return { _mm256_set1_epi8(static_cast<char>(b)) }; }
+
+    Bytes operator&(Bytes o) const { return { _mm256_and_si256(v, o.v) }; }
+    Bytes operator|(Bytes o) const { return { _mm256_or_si256(v, o.v) }; }
+    Bytes operator^(Bytes o) const { return { _mm256_xor_si256(v, o.v) }; }
+    Bytes operator+(Bytes o) const { return { _mm256_add_epi8(v, o.v) }; }
+    Bytes operator-(Bytes o) const { return { _mm256_sub_epi8(v, o.v) }; }
+
+    // 0xFF where equal, or where this is at least `o`, unsigned
+    Bytes operator==(Bytes o) const { return { _mm256_cmpeq_epi8(v, o.v) }; }
+    Bytes operator>=(Bytes o) const { return { _mm256_cmpeq_epi8(_mm256_max_epu8(v, o.v), v) }; }
+
+    Bytes Shr1() const { return { _mm256_and_si256(_mm256_srli_epi16(v, 1), _mm256_set1_epi8(0x7F)) }; }
+    Bytes Shr7() const { return { _mm256_and_si256(_mm256_srli_epi16(v, 7), _mm256_set1_epi8(0x01)) }; }
+#elif defined(__SSE2__)
+    __m128i l, h;
+
+    template <typename F>
+    static Bytes Map(Bytes a, Bytes b, F &&f) { return { f(a.l, b.l), f(a.h, b.h) }; }
+
+    static Bytes Load(const uint8_t *p) {
+      return { _mm_load_si128(reinterpret_cast<const __m128i *>(p)), _mm_load_si128(reinterpret_cast<const __m128i *>(p + 16)) };
+    }
+    void Store(uint8_t *p) const {
+      _mm_store_si128(reinterpret_cast<__m128i *>(p), l);
+      _mm_store_si128(reinterpret_cast<__m128i *>(p + 16), h);
+    }
+    static Bytes Splat(uint8_t b) { return { _mm_set1_epi8(static_cast<char>(b)), _mm_set1_epi8(static_cast<char>(b)) }; }
+
+    Bytes operator&(Bytes o) const { return Map(*this, o, [](__m128i a, __m128i b) { return _mm_and_si128(a, b); }); }
+    Bytes operator|(Bytes o) const { return Map(*this, o, [](__m128i a, __m128i b) { return _mm_or_si128(a, b); }); }
+    Bytes operator^(Bytes o) const { return Map(*this, o, [](__m128i a, __m128i b) { return _mm_xor_si128(a, b); }); }
+    Bytes operator+(Bytes o) const { return Map(*this, o, [](__m128i a, __m128i b) { return _mm_add_epi8(a, b); }); }
+    Bytes operator-(Bytes o) const { return Map(*this, o, [](__m128i a, __m128i b) { return _mm_sub_epi8(a, b); }); }
+
+    Bytes operator==(Bytes o) const { return Map(*this, o, [](__m128i a, __m128i b) { return _mm_cmpeq_epi8(a, b); }); }
+    Bytes operator>=(Bytes o) const {
+      return Map(*this, o, [](__m128i a, __m128i b) { return _mm_cmpeq_epi8(_mm_max_epu8(a, b), a); });
+    }
+
+    Bytes Shr1() const { return { _mm_and_si128(_mm_srli_epi16(l, 1), _mm_set1_epi8(0x7F)), _mm_and_si128(_mm_srli_epi16(h, 1), _mm_set1_epi8(0x7F)) }; }
+    Bytes Shr7() const { return { _mm_and_si128(_mm_srli_epi16(l, 7), _mm_set1_epi8(0x01)), _mm_and_si128(_mm_srli_epi16(h, 7), _mm_set1_epi8(0x01)) }; }
+#else
+    alignas(32) uint8_t v[32];
+
+    template <typename F>
+    static Bytes Map(F &&f) {
+      Bytes r;
+      for (size_t i = 0; i < 32; i++) { r.v[i] = static_cast<uint8_t>(f(i)); }
+      return r;
+    }
+
+    static Bytes Load(const uint8_t *p) { return Map([p](size_t i) { return p[i]; }); }
+    void Store(uint8_t *p) const { for (size_t i = 0; i < 32; i++) { p[i] = v[i]; } }
+    static Bytes Splat(uint8_t b) { return Map([b](size_t) { return b; }); }
+
+    Bytes operator&(const Bytes &o) const { return Map([&](size_t i) { return v[i] & o.v[i]; }); }
+    Bytes operator|(const Bytes &o) const { return Map([&](size_t i) { return v[i] | o.v[i]; }); }
+    Bytes operator^(const Bytes &o) const { return Map([&](size_t i) { return v[i] ^ o.v[i]; }); }
+    Bytes operator+(const Bytes &o) const { return Map([&](size_t i) { return v[i] + o.v[i]; }); }
+    Bytes operator-(const Bytes &o) const { return Map([&](size_t i) { return v[i] - o.v[i]; }); }
+
+    Bytes operator==(const Bytes &o) const { return Map([&](size_t i) { return v[i] == o.v[i] ? 0xFF : 0x00; }); }
+    Bytes operator>=(const Bytes &o) const { return Map([&](size_t i) { return v[i] >= o.v[i] ? 0xFF : 0x00; }); }
+
+    Bytes Shr1() const { return Map([&](size_t i) { return v[i] >> 1; }); }
+    Bytes Shr7() const { return Map([&](size_t i) { return v[i] >> 7; }); }
+#endif
+  };
+
+  // `value` in the lanes set in m, bit by bit, and `old` elsewhere
+  static inline Bytes Blend(Bytes m, Bytes old, Bytes value) {
+    return old ^ ((old ^ value) & m);
+  }
+
+  static inline Bytes NZ(Bytes value) {
+    return (value & Bytes::Splat(FLAG_N)) | ((value == Bytes::Splat(0x00)) & Bytes::Splat(FLAG_Z));
+  }
+
+  // Writes `value` to a register and N and Z from it.
+  static inline void Assign(Bytes m, Bytes &output, Bytes &p, Bytes value) {
+    output = Blend(m, output, value);
+    p      = Blend(m & Bytes::Splat(FLAG_N | FLAG_Z), p, NZ(value));
+  }
+
+  // MOS6502T::ADC (and SBC, with the input inverted): AdcResult(), with the
+  // decimal adjustment in the lanes set in `decimal`. AdcResult() works on a
+  // 9-bit sum; here it is the byte and a count of the carries out of it, whose
+  // low bit is the carry flag.
+  static inline void Add(Bytes m, Bytes decimal, Bytes &a, Bytes &p, Bytes input) {
+    const Bytes one      = Bytes::Splat(0x01);
+    const Bytes sum      = a + input + (p & Bytes::Splat(FLAG_C));
+    const Bytes overflow = ((a ^ sum) & (input ^ sum) & Bytes::Splat(0x80)).Shr1();
+    Bytes carry = ((a & input) | ((a | input) & (sum ^ Bytes::Splat(0xFF)))).Shr7();
+
+    // (temp & 0x00F) > 0x09: temp += 0x06
+    const Bytes low = decimal & ((sum & Bytes::Splat(0x0F)) >= Bytes::Splat(0x0A));
+    Bytes adjusted = sum + (low & Bytes::Splat(0x06));
+    carry = carry + (low & (sum >= Bytes::Splat(0xFA)) & one);
+
+    // (temp & 0xFF0) > 0x90: temp += 0x60
+    const Bytes above = adjusted >= Bytes::Splat(0xA0);
+    const Bytes high  = decimal & (above | ((carry == Bytes::Splat(0x00)) ^ Bytes::Splat(0xFF)));
+    adjusted = adjusted + (high & Bytes::Splat(0x60));
+    carry    = carry + (high & above & one);
+
+    p = Blend(m & Bytes::Splat(FLAG_N | FLAG_Z | FLAG_V | FLAG_C), p, NZ(adjusted) | overflow | (carry & one));
+    a = Blend(m, a, adjusted);
+  }
+
+  // MOS6502T::CMP
+  static inline void Compare(Bytes m, Bytes &p, Bytes reg, Bytes input) {
+    const Bytes carry = (reg >= input) & Bytes::Splat(FLAG_C);
+    p = Blend(m & Bytes::Splat(FLAG_N | FLAG_Z | FLAG_C), p, NZ(reg - input) | carry);
+  }
+
+  static inline void Flag(Bytes m, Bytes &p, uint8_t flag, bool set) {
+    p = Blend(m & Bytes::Splat(flag), p, Bytes::Splat(set ? 0xFF : 0x00));
+  }
+
+};
+
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Run(uint64_t budget) {
+  for (size_t lane = 0; lane < LANES; lane++) {
+    Machine &machine = *lanes[lane];
+    Gather(lane);
+    end[lane] = (budget > UINT64_MAX - cycles[lane]) ? UINT64_MAX : cycles[lane] + budget;
+
+    // As Run() starts a lane.
+    machine.running = true;
+    machine.runEnd  = end[lane];
+    ++machine.idleEpoch;
+    machine.ClearBreak();
+
+    done[lane] = cycles[lane] >= end[lane];
+    solo[lane] = PROFILED || machine.trace;
+    idle[lane] = machine.idleSkipEnabled;
+    due[lane]  = machine.nextEventCycle;
+    bcd[lane]  = machine.DecimalEnabled() ? FLAG_D : 0x00;
+
+    // The host may have changed the lane's memory since the last run.
+    ++epoch[lane];
+  }
+
+  intact = false;
+  while (Step()) {}
+
+  for (size_t lane = 0; lane < LANES; lane++) {
+    Machine &machine = *lanes[lane];
+    Scatter(lane);
+    ++machine.stateEpoch;
+    machine.runEnd = 0;
+  }
+}
+
+// Runs the leader's group or burst. Returns false once every lane is done.
+template <typename Machine, size_t LANES>
+bool Lockstep<Machine, LANES>::Step() {
+  if (intact && PC[members[0]] < fence && cycles[members[0]] < reach) {
+    Group(PC[members[0]]);
+    return true;
+  }
+  intact = false;
+
+  // The scans below keep to selects rather than branches: which lanes are
+  // done, grouped or ahead changes from one step to the next.
+  uint64_t slowest = UINT64_MAX;
+  for (size_t lane = 0; lane < LANES; lane++) {
+    done[lane] |= cycles[lane] >= end[lane];
+    slowest = std::min(slowest, done[lane] ? UINT64_MAX : cycles[lane]);
+  }
+  if (slowest == UINT64_MAX) { return false; }
+
+  // The lowest PC, then the lowest lane, among those within the window.
+  const uint64_t horizon = Ahead(slowest);
+  uint32_t lowest = UINT32_MAX;
+  for (size_t lane = 0; lane < LANES; lane++) {
+    const uint32_t key = uint32_t(PC[lane]) << 16 | static_cast<uint32_t>(lane);
+    lowest = std::min(lowest, (done[lane] || cycles[lane] >= horizon) ? UINT32_MAX : key);
+  }
+  const size_t leader = lowest & 0xFFFF;
+  if (solo[leader]) {
+    Burst(leader, false);
+    return true;
+  }
+
+  const uint16_t pc = PC[leader];
+  uint64_t others = UINT64_MAX;
+  memberCount = 0;
+  idling      = false;
+  for (size_t lane = 0; lane < LANES; lane++) {
+    const bool member = !done[lane] && !solo[lane] && PC[lane] == pc;
+    group[lane]          = member ? 0xFF : 0x00;
+    members[memberCount] = static_cast<uint8_t>(lane);
+    memberCount         += member;
+    idling               = idling || (member && idle[lane]);
+    others               = std::min(others, (done[lane] || member) ? UINT64_MAX : cycles[lane]);
+  }
+
+  if (memberCount == 1) {
+    Burst(leader, true);
+    return true;
+  }
+
+  reach = Ahead(others);
+  fence = 0x10000;
+  for (size_t lane = 0; lane < LANES; lane++) {
+    const bool waiting = !done[lane] && !group[lane] && cycles[lane] < reach;
+    fence = std::min<uint32_t>(fence, waiting ? PC[lane] : 0x10000);
+  }
+
+  headroom = 0;
+  Group(pc);
+  return true;
+}
+
+// Runs a lane on its own until it is WINDOW cycles ahead of the others or,
+// when `join` is set, until it reaches a PC where another lane waits.
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Burst(size_t lane, bool join) {
+  uint64_t others = UINT64_MAX;
+  for (size_t other = 0; other < LANES; other++) {
+    if (other == lane || done[other]) { continue; }
+    others = std::min(others, cycles[other]);
+    if (join && !solo[other]) { joins[PC[other] >> 6] |= uint64_t(1) << (PC[other] & 63); }
+  }
+
+  Scalar(lane, std::min(end[lane], Ahead(others)), false, join);
+
+  if (join) {
+    for (size_t other = 0; other < LANES; other++) { joins[PC[other] >> 6] = 0; }
+  }
+}
+
+// Runs at least one instruction on the lane's own core, and more up to
+// `limit` unless `once` is set, as Run() would.
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Scalar(size_t lane, uint64_t limit, bool once, bool join) {
+  Machine &machine = *lanes[lane];
+  const uint64_t start = cycles[lane];
+  Scatter(lane);
+
+  if (machine.trace) {
+    Core &core = machine;
+    do {
+      core.ExecuteTraced();
+    } while (!once && machine.running && core.cycles < limit && !(join && Joins(core.PC.w)));
+  } else if (machine.mappedPages) {
+    typename Machine::Local local(machine);
+    Execute(machine, local, limit, once, join);
+    local.Leave();
+  } else {
+    Execute(machine, static_cast<Core &>(machine), limit, once, join);
+  }
+
+  Gather(lane);
+  stats.scalarCycles += cycles[lane] - start;
+  done[lane] = !machine.running || cycles[lane] >= end[lane];
+  idle[lane] = machine.idleSkipEnabled;
+  due[lane]  = machine.nextEventCycle;
+
+  // Its stores, or the host's callbacks, may have changed its code.
+  ++epoch[lane];
+}
+
+// MOS6502Core::Run(), stopping after one instruction or where another lane
+// waits when asked to.
+template <typename Machine, size_t LANES>
+template <typename LaneCore>
+void Lockstep<Machine, LANES>::Execute(Machine &machine, LaneCore &core, uint64_t limit, bool once, bool join) {
+  do {
+    if (!core.Poll()) { return; }
+    if (once || !machine.codeCacheEnabled || !core.ExecuteBlock(limit)) { core.Instruction(); }
+  } while (!once && machine.running && core.cycles < limit && !(join && Joins(core.PC.w)));
+}
+
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Gather(size_t lane) {
+  const Machine &machine = *lanes[lane];
+  PC[lane]     = machine.PC.w;
+  A[lane]      = machine.A;
+  X[lane]      = machine.X;
+  Y[lane]      = machine.Y;
+  S[lane]      = machine.S;
+  P[lane]      = machine.Status();
+  cycles[lane] = machine.cycles;
+}
+
+// Writes the registers straight into the core, as a running core would have
+// left them; SetRegisters() would also restart idle-loop detection.
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Scatter(size_t lane) {
+  Machine &machine = *lanes[lane];
+  machine.PC.w   = PC[lane];
+  machine.A      = A[lane];
+  machine.X      = X[lane];
+  machine.Y      = Y[lane];
+  machine.S      = S[lane];
+  machine.SetStatus(P[lane]);
+  machine.cycles = cycles[lane];
+}
+
+// Runs the instruction at `pc` across the group. Members whose code differs,
+// or that cannot run it without the bus or a Poll(), run it on their own.
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Group(uint16_t pc) {
+  apartCount = 0;
+  intact     = true;
+  if (!headroom) { Check(); }
+
+  if (memberCount) {
+    Decoded &entry = Lookup(pc);
+    size_t count = 0;
+    for (size_t member = 0; member < memberCount; member++) {
+      const size_t lane = members[member];
+      if ((entry.epoch[lane] != epoch[lane] && !Decode(entry, lane))
+          || lanes[lane]->pending.load(std::memory_order_relaxed) != 0) {
+        Drop(lane);
+        continue;
+      }
+      members[count++] = static_cast<uint8_t>(lane);
+    }
+    memberCount = count;
+
+    if (memberCount) {
+      if (OPCODE_INFO[entry.opcode].effect == OpcodeInfo::FLOW) {
+        Jump(entry, pc);
+      } else {
+        Access(entry, pc);
+      }
+    }
+  }
+
+  intact = intact && memberCount && apartCount == 0;
+  for (size_t index = 0; index < apartCount; index++) {
+    Scalar(apart[index], end[apart[index]], true, false);
+  }
+}
+
+// Takes the members that have spent their budget out of the group, and
+// leaves those with an event due to take it on their own core; then works
+// out how far the rest can go before it has to look again.
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Check() {
+  headroom = UINT64_MAX;
+  size_t count = 0;
+  for (size_t member = 0; member < memberCount; member++) {
+    const size_t lane = members[member];
+    if (cycles[lane] >= end[lane]) {
+      done[lane]  = 1;
+      group[lane] = 0x00;
+      continue;
+    }
+    if (cycles[lane] >= due[lane]) {
+      Drop(lane);
+      continue;
+    }
+    headroom = std::min(headroom, std::min(end[lane], due[lane]) - cycles[lane]);
+    members[count++] = static_cast<uint8_t>(lane);
+  }
+  memberCount = count;
+}
+
+// The entry for `pc`, started afresh from the first member's code when it
+// holds another PC, or when that code has changed.
+template <typename Machine, size_t LANES>
+typename Lockstep<Machine, LANES>::Decoded &Lockstep<Machine, LANES>::Lookup(uint16_t pc) {
+  Decoded       &entry  = decoded[pc & 0xFF];
+  const size_t   first  = members[0];
+  if (entry.pc == pc && entry.epoch[first] == epoch[first]) { return entry; }
+
+  const uint8_t  offset = pc & 0xFF;
+  const uint8_t *code   = lanes[first]->readPages[pc >> 8];
+  if (entry.pc == pc && code && code[offset] == entry.opcode) { return entry; }
+
+  // Every byte the instruction fetches or dummy reads, through pc + 2, has
+  // to be in the same mapped page.
+  entry.pc        = pc;
+  entry.opcode    = code ? code[offset] : 0x00;
+  entry.operation = (code && offset <= 0xFD) ? OPERATIONS[entry.opcode] : NONE;
+  entry.uniform   = true;
+  entry.epoch.fill(0);
+  if (entry.operation != NONE) {
+    entry.lowFirst  = code[offset + 1];
+    entry.highFirst = code[offset + 2];
+    codePages[pc >> 8] = true;
+  }
+  return entry;
+}
+
+// Reads a lane's operand into the entry, if its code there matches.
+template <typename Machine, size_t LANES>
+bool Lockstep<Machine, LANES>::Decode(Decoded &entry, size_t lane) {
+  const uint8_t  offset = entry.pc & 0xFF;
+  const uint8_t *code   = lanes[lane]->readPages[entry.pc >> 8];
+  if (entry.operation == NONE || !code || code[offset] != entry.opcode) { return false; }
+
+  entry.low[lane]   = code[offset + 1];
+  entry.high[lane]  = code[offset + 2];
+  entry.epoch[lane] = epoch[lane];
+  entry.uniform     = entry.uniform && entry.low[lane] == entry.lowFirst
+                   && (OPCODE_INFO[entry.opcode].size < 3 || entry.high[lane] == entry.highFirst);
+  return true;
+}
+
+// Works out each member's effective address as the addressing modes in
+// MOS6502T.inl do, charges it a page cross, and reads its operand. A member
+// whose pointer, dummy or operand accesses are not all to mapped pages runs
+// the instruction on its own. Returns whether any member crossed a page.
+template <typename Machine, size_t LANES>
+template <OpcodeInfo::MODE MODE>
+bool Lockstep<Machine, LANES>::Fetch(const Decoded &entry, OpcodeInfo::EFFECT effect) {
+  const auto &low  = entry.low;
+  const auto &high = entry.high;
+  uint64_t crossings = 0;
+  size_t   count     = 0;
+  for (size_t member = 0; member < memberCount; member++) {
+    const size_t   lane    = members[member];
+    const Machine &machine = *lanes[lane];
+    const auto    &reads   = machine.readPages;
+    const uint8_t *zero    = reads[0x00];
+    uint16_t target = 0;
+    bool     crossed = false;
+
+    if constexpr (MODE == OpcodeInfo::ZPG) {
+      target = low[lane];
+    } else if constexpr (MODE == OpcodeInfo::ABS) {
+      target = static_cast<uint16_t>(low[lane] | (high[lane] << 8));
+    } else if constexpr (MODE == OpcodeInfo::ZPX || MODE == OpcodeInfo::ZPY) {
+      if (!zero) { Drop(lane); continue; }
+      target = static_cast<uint8_t>(low[lane] + (MODE == OpcodeInfo::ZPX ? X[lane] : Y[lane]));
+    } else if constexpr (MODE == OpcodeInfo::IZX) {
+      if (!zero) { Drop(lane); continue; }
+      const uint8_t pointer = static_cast<uint8_t>(low[lane] + X[lane]);
+      target = static_cast<uint16_t>(zero[pointer] | (zero[static_cast<uint8_t>(pointer + 1)] << 8));
+    } else {
+      // Indexed: reads pay for a page cross with a dummy read in the base's
+      // page; writes and read-modify-writes always make it.
+      uint16_t base  = static_cast<uint16_t>(low[lane] | (high[lane] << 8));
+      uint8_t  index = (MODE == OpcodeInfo::ABX) ? X[lane] : Y[lane];
+      if constexpr (MODE == OpcodeInfo::IZY) {
+        if (!zero) { Drop(lane); continue; }
+        base = static_cast<uint16_t>(zero[low[lane]] | (zero[static_cast<uint8_t>(low[lane] + 1)] << 8));
+      }
+      target  = static_cast<uint16_t>(base + index);
+      crossed = (base ^ target) & 0xFF00;
+      if ((effect != OpcodeInfo::READ || crossed) && !reads[base >> 8]) { Drop(lane); continue; }
+      crossed = crossed && effect == OpcodeInfo::READ;
+    }
+
+    const uint8_t *read  = reads[target >> 8];
+    uint8_t       *write = machine.writePages[target >> 8];
+    if (effect != OpcodeInfo::WRITE && !read) { Drop(lane); continue; }
+    if (effect != OpcodeInfo::READ && !write) { Drop(lane); continue; }
+    if (effect != OpcodeInfo::WRITE) { value[lane] = read[target & 0xFF]; }
+    if (effect != OpcodeInfo::READ) { cell[lane] = write + (target & 0xFF); }
+    address[lane]    = target;
+    cycles[lane]    += crossed;
+    crossings       += crossed;
+    members[count++] = static_cast<uint8_t>(lane);
+  }
+  memberCount = count;
+  stats.vectorCycles += crossings;
+  return crossings != 0;
+}
+
+// Loads, stores, ALU, read-modify-write, register and flag operations.
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Access(const Decoded &entry, uint16_t pc) {
+  const OpcodeInfo &info      = OPCODE_INFO[entry.opcode];
+  const Operation   operation = entry.operation;
+  bool crossed = false;
+
+  switch (info.mode) {
+    case OpcodeInfo::ZPG: crossed = Fetch<OpcodeInfo::ZPG>(entry, info.effect); break;
+    case OpcodeInfo::ZPX: crossed = Fetch<OpcodeInfo::ZPX>(entry, info.effect); break;
+    case OpcodeInfo::ZPY: crossed = Fetch<OpcodeInfo::ZPY>(entry, info.effect); break;
+    case OpcodeInfo::ABS: crossed = Fetch<OpcodeInfo::ABS>(entry, info.effect); break;
+    case OpcodeInfo::ABX: crossed = Fetch<OpcodeInfo::ABX>(entry, info.effect); break;
+    case OpcodeInfo::ABY: crossed = Fetch<OpcodeInfo::ABY>(entry, info.effect); break;
+    case OpcodeInfo::IZX: crossed = Fetch<OpcodeInfo::IZX>(entry, info.effect); break;
+    case OpcodeInfo::IZY: crossed = Fetch<OpcodeInfo::IZY>(entry, info.effect); break;
+    default: break;
+  }
+  if (!memberCount) { return; }
+
+  Operate(operation, info.mode == OpcodeInfo::ACC, (info.mode == OpcodeInfo::IMM) ? entry.low.data() : value.data());
+
+  // The stores go through `uint8_t` pointers, which may alias anything, so
+  // everything they need is loaded first.
+  if (info.effect == OpcodeInfo::WRITE || info.effect == OpcodeInfo::MODIFY) {
+    const size_t count = memberCount;
+    for (size_t member = 0; member < count; member++) {
+      const size_t   lane    = members[member];
+      Machine       &machine = *lanes[lane];
+      const uint16_t where   = address[lane];
+      uint8_t       *target  = cell[lane];
+      const auto     journal = machine.journal;
+      const bool     code    = codePages[where >> 8];
+      uint8_t output = value[lane];
+      if (operation == STA) { output = A[lane]; }
+      if (operation == STX) { output = X[lane]; }
+      if (operation == STY) { output = Y[lane]; }
+
+      // A read-modify-write stores its input back before the result.
+      if (info.effect == OpcodeInfo::MODIFY) {
+        const uint8_t input = machine.readPages[where >> 8][where & 0xFF];
+        if (journal) { journal->Append(where, *target); }
+        *target = input;
+      }
+      if (journal) { journal->Append(where, *target); }
+      *target = output;
+
+      // A store into decoded code makes the lane decode it again.
+      epoch[lane] += code;
+    }
+  }
+
+  Settle(static_cast<uint16_t>(pc + info.size), info.cycles);
+  if (crossed) { Spend(1); }
+}
+
+// Branches and JMP. The members move on together while they all go the
+// same way to the same place; otherwise the group splits. A taken backward
+// one on a lane skipping idle loops goes through the lane's own core, which
+// checks for an idle loop.
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Jump(const Decoded &entry, uint16_t pc) {
+  // N, V, C or Z by bits 7-6, and the state that takes the branch by bit 5
+  static constexpr uint8_t FLAGS[4] = { FLAG_N, FLAG_V, FLAG_C, FLAG_Z };
+  const bool     jump = entry.operation == JMP;
+  const uint8_t  flag = FLAGS[entry.opcode >> 6];
+  const uint8_t  when = (entry.opcode & 0x20) ? flag : 0x00;
+  const uint16_t next = static_cast<uint16_t>(pc + 2);
+
+  size_t taken = memberCount;
+  if (!jump) {
+    taken = 0;
+    for (size_t member = 0; member < memberCount; member++) { taken += (P[members[member]] & flag) == when; }
+  }
+
+  if (entry.uniform && (taken == 0 || taken == memberCount)) {
+    const uint16_t target = jump ? static_cast<uint16_t>(entry.lowFirst | (entry.highFirst << 8))
+                                 : static_cast<uint16_t>(next + static_cast<int8_t>(entry.lowFirst));
+    if (!taken) {
+      Settle(next, 2);
+      return;
+    }
+    if (target > pc || !idling) {
+      Settle(target, (jump || !((next ^ target) & 0xFF00)) ? 3 : 4);
+      return;
+    }
+  }
+
+  intact = false;
+  uint64_t total = 0;
+  size_t   count = 0;
+  for (size_t member = 0; member < memberCount; member++) {
+    const size_t lane = members[member];
+    uint16_t target = static_cast<uint16_t>(next + static_cast<int8_t>(entry.low[lane]));
+    uint8_t  spent  = 2;
+    if (jump) {
+      target = static_cast<uint16_t>(entry.low[lane] | (entry.high[lane] << 8));
+      spent  = 3;
+    } else if ((P[lane] & flag) == when) {
+      spent = ((next ^ target) & 0xFF00) ? 4 : 3;
+    } else {
+      target = next;
+    }
+    if (spent > 2 && target <= pc && idle[lane]) { Drop(lane); continue; }
+
+    PC[lane]         = target;
+    cycles[lane]    += spent;
+    total           += spent;
+    members[count++] = static_cast<uint8_t>(lane);
+  }
+  memberCount = count;
+  stats.vectorCycles += total;
+  Spend(4);
+  Regroup();
+}
+
+// After a split, goes on with the members at the lowest PC if they would be
+// chosen again, and leaves the rest waiting with the other lanes.
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Regroup() {
+  uint32_t lowest = 0x10000;
+  for (size_t member = 0; member < memberCount; member++) { lowest = std::min<uint32_t>(lowest, PC[members[member]]); }
+  if (lowest >= fence) { return; }
+
+  size_t count = 0;
+  for (size_t member = 0; member < memberCount; member++) {
+    const size_t lane = members[member];
+    if (PC[lane] == lowest) {
+      members[count++] = static_cast<uint8_t>(lane);
+      continue;
+    }
+    group[lane] = 0x00;
+    fence = std::min<uint32_t>(fence, PC[lane]);
+    reach = std::min(reach, Ahead(cycles[lane]));
+  }
+  memberCount = count;
+  intact      = cycles[members[0]] < reach;
+}
+
+// Moves every member on to `next`, `spent` cycles later.
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Settle(uint16_t next, uint8_t spent) {
+  // AVX2 widens the group mask to the cycle counts cheaply enough to sweep
+  // every lane; narrower vectors do better walking the members.
+#if defined(__AVX2__)
+  for (size_t lane = 0; lane < LANES; lane++) {
+    const bool member = group[lane] != 0;
+    PC[lane]      = member ? next : PC[lane];
+    cycles[lane] += member ? spent : 0;
+  }
+#else
+  for (size_t member = 0; member < memberCount; member++) {
+    const size_t lane = members[member];
+    PC[lane]      = next;
+    cycles[lane] += spent;
+  }
+#endif
+  stats.vectorCycles += uint64_t(spent) * memberCount;
+  Spend(spent);
+}
+
+// The register and flag updates of every operation Access() runs, across
+// the group, on each member's `operand`; `value` takes the result of a
+// read-modify-write.
+template <typename Machine, size_t LANES>
+void Lockstep<Machine, LANES>::Operate(Operation operation, bool accumulator, const uint8_t *operand) {
+  for (size_t chunk = 0; chunk < WIDTH; chunk += 32) {
+    const Bytes m = Bytes::Load(&group[chunk]);
+    Bytes a = Bytes::Load(&A[chunk]);
+    Bytes x = Bytes::Load(&X[chunk]);
+    Bytes y = Bytes::Load(&Y[chunk]);
+    Bytes s = Bytes::Load(&S[chunk]);
+    Bytes p = Bytes::Load(&P[chunk]);
+    Bytes v = Bytes::Load(&operand[chunk]);
+
+    const Bytes one     = Bytes::Splat(0x01);
+    const Bytes carryIn = p & Bytes::Splat(FLAG_C);
+    const Bytes source  = accumulator ? a : v;
+    Bytes shifted = source;
+    Bytes carry   = Bytes::Splat(0x00);
+
+    switch (operation) {
+      case LDA: Assign(m, a, p, v); break;
+      case LDX: Assign(m, x, p, v); break;
+      case LDY: Assign(m, y, p, v); break;
+
+      case AND: Assign(m, a, p, a & v); break;
+      case ORA: Assign(m, a, p, a | v); break;
+      case EOR: Assign(m, a, p, a ^ v); break;
+
+      case ADC:
+      case SBC: {
+        const Bytes decimal = (p & Bytes::Load(&bcd[chunk])) == Bytes::Splat(FLAG_D);
+        Add(m, decimal, a, p, (operation == SBC) ? v ^ Bytes::Splat(0xFF) : v);
+        break;
+      }
+
+      case CMP: Compare(m, p, a, v); break;
+      case CPX: Compare(m, p, x, v); break;
+      case CPY: Compare(m, p, y, v); break;
+
+      case BIT:
+        p = Blend(m & Bytes::Splat(FLAG_N | FLAG_V | FLAG_Z), p,
+                  (v & Bytes::Splat(FLAG_N | FLAG_V)) | (((a & v) == Bytes::Splat(0x00)) & Bytes::Splat(FLAG_Z)));
+        break;
+
+      case INC: Assign(m, v, p, v + one); break;
+      case DEC: Assign(m, v, p, v - one); break;
+
+      case ASL: shifted = source + source;           carry = source.Shr7(); break;
+      case LSR: shifted = source.Shr1();             carry = source & one;  break;
+      case ROL: shifted = (source + source) | carryIn; carry = source.Shr7(); break;
+      case ROR:
+        shifted = source.Shr1() | ((carryIn == one) & Bytes::Splat(0x80));
+        carry   = source & one;
+        break;
+
+      case TAX: Assign(m, x, p, a); break;
+      case TAY: Assign(m, y, p, a); break;
+      case TSX: Assign(m, x, p, s); break;
+      case TXA: Assign(m, a, p, x); break;
+      case TYA: Assign(m, a, p, y); break;
+      case TXS: s = Blend(m, s, x); break;
+
+      case INX: Assign(m, x, p, x + one); break;
+      case INY: Assign(m, y, p, y + one); break;
+      case DEX: Assign(m, x, p, x - one); break;
+      case DEY: Assign(m, y, p, y - one); break;
+
+      case CLC: Flag(m, p, FLAG_C, false); break;
+      case SEC: Flag(m, p, FLAG_C, true);  break;
+      case CLD: Flag(m, p, FLAG_D, false); break;
+      case SED: Flag(m, p, FLAG_D, true);  break;
+      case CLI: Flag(m, p, FLAG_I, false); break;
+      case SEI: Flag(m, p, FLAG_I, true);  break;
+      case CLV: Flag(m, p, FLAG_V, false); break;
+
+      default: break;
+    }
+
+    if (operation == ASL || operation == LSR || operation == ROL || operation == ROR) {
+      Assign(m, accumulator ? a : v, p, shifted);
+      p = Blend(m & Bytes::Splat(FLAG_C), p, carry);
+    }
+
+    a.Store(&A[chunk]);
+    x.Store(&X[chunk]);
+    y.Store(&Y[chunk]);
+    s.Store(&S[chunk]);
+    p.Store(&P[chunk]);
+    v.Store(&value[chunk]);
+  }
+
+}
@@ -0,0 +1,942 @@
+//
+// MOS6502T.h
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "MOS6502/Alu.h"
+#include "MOS6502/InputLog.h"
+#include "MOS6502/Journal.h"
+#include "MOS6502/Opcodes.h"
+#include "MOS6502/Profiler.h"
+#include "MOS6502/Trace.h"
+#include "MOS6502/Variants.h"
+
+// Define as 1 (GCC/Clang only) to have Run() use threaded computed-goto
+// dispatch instead of a switch. Both are generated from OpcodeTable.inc.
+#ifndef MOS6502_COMPUTED_GOTO
+#define MOS6502_COMPUTED_GOTO 0
+#endif
+
+// Define as 1 (GCC/Clang only) to inline everything a mapped Run() calls into
+// one function. It runs mapped code faster, but every translation unit that
+// runs a CPU then takes minutes to compile.
+#ifndef MOS6502_FLATTEN
+#define MOS6502_FLATTEN 0
+#endif
+
+//
+// The CPU core, parameterised on the bus.
+//
+// Bus is the derived class (CRTP). It must publicly provide:
+//
+//   uint8_t Load(uint16_t address, bool peek = false);
+//   void    Store(uint16_t address, uint8_t value);
+//
+// and may provide OnUnknownOpcode(uint8_t) to replace the default no-op.
+// All bus calls are bound at compile time, so a Bus whose Load/Store are
+// visible at the point Run() is instantiated can be inlined into dispatch.
+//
+// Variant fixes decimal mode and illegal opcode support at compile time (see
+// Variants.h); the default keeps them as the runtime flags below. A Profiled<>
+// variant also inherits the execution profiler from Profiler.h.
+//
+
+template <typename Bus, typename Variant>
+class MOS6502T;
+
+template <typename Machine, size_t LANES>
+class Lockstep;
+
+template <typename Machine>
+class Rewind;
+
+//
+// Execution
+//
+// Instructions run in a core, which holds the registers and the cycle
+// counter. The CPU's own core is its private base, MOS6502Core<..., false>,
+// and runs in place: Step() and an unmapped Run() execute on the CPU's own
+// members, as every callback expects to see them.
+//
+// Once any page is mapped, Run() runs a local core instead, a copy of the
+// registers on the stack that is loaded when the run starts and written back
+// when it ends. Nothing outside the core can see that copy, so the compiler
+// keeps it in host registers and a store through a page pointer no longer
+// forces it to be reloaded. A call into the bus still needs it written back
+// first and kept across the call, which costs more than it saves when nearly
+// every access is one; hence only once pages are mapped.
+//
+// A local core Leave()s before anything outside it runs (the bus, the
+// debugger and input log hooks, events and the idle-loop check), so they all
+// see the CPU as it is at that cycle, and Resume()s after, reloading only if
+// that code changed the CPU with SetRegisters(), LoadState(), Reset() or a
+// nested Step() or Run(). The in-place core has nothing to sync and both are
+// no-ops.
+//
+
+// The register types, shared by both kinds of core.
+struct MOS6502Types
+{
+
+  union Reg16 {
+    uint16_t w;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    struct { uint8_t h, l; };
+#else
+    struct { uint8_t l, h; };
+#endif
+    Reg16 &operator=(uint16_t v) { w = v; return *this; }
+  };
+
+  static_assert(sizeof(Reg16) == 2, "Reg16 must be exactly 2 bytes");
+
+  using WORD = Reg16;
+  using BYTE = uint8_t;
+
+  // B (bit 4) and U (bit 5), set when BRK/PHP pushes P
+  static constexpr uint8_t P_BT_MASK = 0x30;
+
+  // Only I, D, B and U are kept in P (see MOS6502Core::flagN).
+  union StatusBits {
+    BYTE value;
+    struct { uint8_t C:1, Z:1, I:1, D:1, B:1, U:1, V:1, N:1; };
+  };
+
+  static_assert(sizeof(StatusBits) == 1, "P register bitfield must be exactly 1 byte; bit ordering assumes LSB-first packing (GCC/Clang default)");
+
+  // A predecoded instruction. `cycles` counts its opcode and operand fetches,
+  // which DispatchDecoded() charges, and advances PC over, without reading
+  // the page again.
+  struct Op {
+    uint8_t opcode;
+    uint8_t cycles;
+    WORD    operand;
+  };
+
+};
+
+template <typename Bus, typename Variant, bool LOCAL>
+class MOS6502Core : public MOS6502Types
+{
+
+  friend class MOS6502T<Bus, Variant>;
+  template <typename, typename, bool> friend class MOS6502Core;
+  template <typename, size_t> friend class Lockstep;
+
+  using CPU    = MOS6502T<Bus, Variant>;
+  using Core   = MOS6502Core;
+  using Stored = MOS6502Core<Bus, Variant, false>;
+
+  // Operand bytes an opcode fetches before its body runs: all of them,
+  // except for JSR, which fetches its high byte after the pushes.
+  static constexpr uint8_t OperandBytes(uint8_t opcode, OpcodeInfo::MODE mode) {
+    return (opcode == 0x20) ? 1 : OpcodeInfo::Size(mode) - 1;
+  }
+
+  WORD PC = { .w = 0x0000 };
+
+  BYTE A = 0x00;
+  BYTE X = 0x00;
+  BYTE Y = 0x00;
+  BYTE S = 0xFF;
+
+  // The flags nearly every instruction sets are kept unpacked, so setting
+  // them is a plain byte store: N is bit 7 of flagN, Z is set when flagZ is
+  // zero, and C and V are 0 or 1. Status() packs the whole register for
+  // PHP, BRK, interrupts and save states.
+  StatusBits P = { .value = 0x34 };
+
+  BYTE flagN = 0x00;
+  BYTE flagZ = 0x01;
+  BYTE flagC = 0;
+  BYTE flagV = 0;
+
+  uint64_t cycles = 0;
+
+  // A local core's CPU, and the CPU's stateEpoch when the copy was loaded.
+  struct Link {
+    CPU     *cpu;
+    uint32_t epoch;
+  };
+
+  struct Unlinked {};
+
+  std::conditional_t<LOCAL, Link, Unlinked> link = {};
+
+  MOS6502Core() = default;
+
+  explicit MOS6502Core(CPU &cpu) : link{ &cpu, 0 } { Enter(); }
+
+  inline CPU &cpu() {
+    if constexpr (LOCAL) { return *link.cpu; } else { return static_cast<CPU &>(*this); }
+  }
+
+  template <typename To, typename From>
+  static void CopyRegisters(To &to, const From &from) {
+    to.PC     = from.PC;
+    to.A      = from.A;
+    to.X      = from.X;
+    to.Y      = from.Y;
+    to.S      = from.S;
+    to.P      = from.P;
+    to.flagN  = from.flagN;
+    to.flagZ  = from.flagZ;
+    to.flagC  = from.flagC;
+    to.flagV  = from.flagV;
+    to.cycles = from.cycles;
+  }
+
+  inline void Enter() {
+    if constexpr (LOCAL) {
+      CopyRegisters<Core, Stored>(*this, cpu());
+      link.epoch = cpu().stateEpoch;
+    }
+  }
+
+  inline void Leave() {
+    if constexpr (LOCAL) { CopyRegisters<Stored, Core>(cpu(), *this); }
+  }
+
+  // After a callback, which rarely changes the CPU: reloads only if it did.
+  inline void Resume() {
+    if constexpr (LOCAL) {
+      if (cpu().stateEpoch != link.epoch) { Enter(); }
+    }
+  }
+
+  inline uint8_t Status() const {
+    return (P.value & 0x3C) | (flagN & 0x80) | (flagV << 6) | (flagZ ? 0x00 : 0x02) | flagC;
+  }
+
+  inline void SetStatus(uint8_t value) {
+    P.value = value;
+    flagN   = value;
+    flagZ   = ~value & 0x02;
+    flagC   = value & 0x01;
+    flagV   = (value >> 6) & 0x01;
+  }
+
+  //
+  // Bus Access
+  //
+
+  [[gnu::always_inline]] inline uint8_t Read(uint16_t address) {
+    ++cycles;
+    if (const uint8_t *page = cpu().readPages[address >> 8]) { return page[address & 0xFF]; }
+    Leave();
+    const uint8_t value = cpu().readHooks ? cpu().LoadHooked(address) : cpu().bus().Load(address);
+    Resume();
+    return value;
+  }
+
+  [[gnu::always_inline]] inline void Write(uint16_t address, uint8_t value) {
+    ++cycles;
+    if (uint8_t *page = cpu().writePages[address >> 8]) {
+      if (cpu().journal) { cpu().journal->Append(address, page[address & 0xFF]); }
+      page[address & 0xFF] = value;
+      return;
+    }
+    if (uint8_t *page = cpu().protectedPages[address >> 8]) {
+      if (cpu().journal) { cpu().journal->Append(address, page[address & 0xFF]); }
+      page[address & 0xFF] = value;
+      cpu().InvalidateCodeAt(address);
+      return;
+    }
+    Leave();
+    if (cpu().writeHooks) { cpu().StoreHooked(address, value); } else { cpu().bus().Store(address, value); }
+    Resume();
+  }
+
+  inline void Unknown(uint8_t opcode) {
+    Leave();
+    cpu().bus().OnUnknownOpcode(opcode);
+    Resume();
+  }
+
+  //
+  // Helpers
+  //
+
+  // Runs until `end`, Halt() or a stop, through the code cache or threaded
+  // dispatch when they apply.
+  void Run(uint64_t end);
+  void Execute();
+  void ExecuteTraced();
+#if MOS6502_COMPUTED_GOTO
+  void RunThreaded(uint64_t end);
+#endif
+  bool ExecuteBlock(uint64_t end);
+
+  // Forced inline so each run loop keeps a single flat dispatch even though
+  // they share these.
+  [[gnu::always_inline]] inline bool Poll();
+  [[gnu::always_inline]] inline void Instruction();
+  [[gnu::always_inline]] inline void Dispatch(BYTE opcode);
+  [[gnu::always_inline]] inline void DispatchDecoded(const Op &op);
+
+  inline void Branch(WORD operand, bool test) {
+    const int8_t offset = static_cast<int8_t>(operand.l);
+
+    if constexpr (Variant::PROFILE) { cpu().ProfileBranch(test); }
+
+    if (test) {
+      Idle();
+      const uint16_t target = static_cast<uint16_t>(PC.w + offset);
+      if ((PC.w ^ target) & 0xFF00) {
+        Read((PC.h << 8) | (target & 0xFF));
+        if constexpr (Variant::PROFILE) { cpu().ProfilePageCross(); }
+      }
+      const uint16_t branch = static_cast<uint16_t>(PC.w - 2);
+      PC.w = target;
+      if (cpu().idleSkipEnabled && target <= branch) { LoopBack(branch, target); }
+    }
+  }
+
+  inline void LoopBack(uint16_t branch, uint16_t target) {
+    Leave();
+    cpu().LoopBack(branch, target);
+    Enter();
+  }
+
+  inline uint8_t Fetch() {
+    return Read(PC.w++);
+  }
+
+  template <uint8_t BYTES>
+  inline WORD FetchOperand() {
+    WORD operand = {};
+    if constexpr (BYTES > 0) { operand.l = Fetch(); }
+    if constexpr (BYTES > 1) { operand.h = Fetch(); }
+    return operand;
+  }
+
+  inline uint8_t Flags(uint8_t value) {
+    flagN = value;
+    flagZ = value;
+    return value;
+  }
+
+  inline void Idle() {
+    Read(PC.w);
+  }
+
+  inline void IdleStack() {
+    Read(0x0100 | S);
+  }
+
+  inline WORD IdleOnPageAlways(WORD base, BYTE index) {
+    WORD TB = { .w = static_cast<uint16_t>(base.w + index) };
+    Read((base.h << 8) | TB.l);
+    return TB;
+  }
+
+  inline WORD IdleOnPageCrossed(WORD base, BYTE index) {
+    WORD TB = { .w = static_cast<uint16_t>(base.w + index) };
+    if (base.l > TB.l) {
+      Read((base.h << 8) | TB.l);
+      if constexpr (Variant::PROFILE) { cpu().ProfilePageCross(); }
+    }
+    return TB;
+  }
+
+  inline void DispatchInterrupt(uint16_t vector) {
+    ++cpu().idleEpoch;
+    Idle();
+    Idle();
+    Push(PC.h);
+    Push(PC.l);
+    Push(Status() | 0x20);
+    PC.l = Read(vector);
+    PC.h = Read(vector + 1);
+    P.I  = 1;
+  }
+
+  [[nodiscard]] inline uint8_t Pull() {
+    return Read(0x0100 | ++S);
+  }
+
+  inline void Push(uint8_t value) {
+    Write(0x0100 | S--, value);
+  }
+
+  void Reset() {
+    S   -= 3;
+    PC.l = Read(0xFFFC);
+    PC.h = Read(0xFFFD);
+    P.I  = 1;
+  }
+
+  //
+  // Addressing Modes
+  //
+
+  using OPERATION = void (Core::*)(BYTE input, BYTE &output);
+
+  template <OPERATION operation> void Absolute_Modify(WORD operand);
+  template <OPERATION operation> void Absolute_Modify(WORD operand, BYTE index);
+  template <OPERATION operation> void Absolute_Read(WORD operand, BYTE &output);
+  template <OPERATION operation> void Absolute_Read(WORD operand, BYTE &output, BYTE index);
+  void Absolute_Write(WORD operand, BYTE &input);
+  void Absolute_Write(WORD operand, BYTE &input, BYTE index);
+  template <OPERATION operation> void Immediate_Read(WORD operand, BYTE &output);
+  template <OPERATION operation> void IndexedIndirect_Read(WORD operand, BYTE &output, BYTE index);
+  void IndexedIndirect_Write(WORD operand, BYTE &input, BYTE index);
+  template <OPERATION operation> void IndirectIndexed_Read(WORD operand, BYTE &output, BYTE index);
+  void IndirectIndexed_Write(WORD operand, BYTE &input, BYTE index);
+  template <OPERATION operation> void ZeroPage_Modify(WORD operand);
+  template <OPERATION operation> void ZeroPage_Modify(WORD operand, BYTE index);
+  template <OPERATION operation> void ZeroPage_Read(WORD operand, BYTE &output);
+  template <OPERATION operation> void ZeroPage_Read(WORD operand, BYTE &output, BYTE index);
+  void ZeroPage_Write(WORD operand, BYTE &input);
+  void ZeroPage_Write(WORD operand, BYTE &input, BYTE index);
+
+  //
+  // Operations
+  //
+
+  void ADC(BYTE input, BYTE &output);
+  void AND(BYTE input, BYTE &output);
+  void ASL(BYTE input, BYTE &output);
+  void BIT(BYTE input, BYTE &output);
+  void CMP(BYTE input, BYTE &output);
+  void DEC(BYTE input, BYTE &output);
+  void EOR(BYTE input, BYTE &output);
+  void INC(BYTE input, BYTE &output);
+  void LDx(BYTE input, BYTE &output);
+  void LSR(BYTE input, BYTE &output);
+  void ORA(BYTE input, BYTE &output);
+  void ROL(BYTE input, BYTE &output);
+  void ROR(BYTE input, BYTE &output);
+  void SBC(BYTE input, BYTE &output);
+
+  //
+  // Control Flow
+  //
+
+  void BRK();
+  void JMP_Absolute(WORD operand);
+  void JMP_Indirect(WORD operand);
+  void JSR(WORD operand);
+  void PLP();
+  void RTI();
+  void RTS();
+
+  //
+  // Illegal Addressing Modes
+  //
+
+  template <OPERATION operation> void IndexedIndirect_Modify(WORD operand, BYTE index);
+  template <OPERATION operation> void IndirectIndexed_Modify(WORD operand, BYTE index);
+  void AbsoluteHigh_Write(WORD operand, BYTE input, BYTE index);
+
+  //
+  // Illegal Operations
+  //
+
+  void ANC(BYTE input, BYTE &output);
+  void ALR(BYTE input, BYTE &output);
+  void ARR(BYTE input, BYTE &output);
+  void AXS(BYTE input, BYTE &output);
+  void DCP(BYTE input, BYTE &output);
+  void ISC(BYTE input, BYTE &output);
+  void LAX(BYTE input, BYTE &output);
+  void LAS(BYTE input, BYTE &output);
+  void NOP(BYTE input, BYTE &output);
+  void RLA(BYTE input, BYTE &output);
+  void RRA(BYTE input, BYTE &output);
+  void SLO(BYTE input, BYTE &output);
+  void SRE(BYTE input, BYTE &output);
+
+};
+
+template <typename Bus, typename Variant = RuntimeVariant>
+class MOS6502T : public Profiler<Variant::PROFILE>, private MOS6502Core<Bus, Variant, false>
+{
+
+public:
+
+  using Reg16 = MOS6502Types::Reg16;
+  using WORD  = MOS6502Types::WORD;
+  using BYTE  = MOS6502Types::BYTE;
+
+  static constexpr uint8_t P_BT_MASK = MOS6502Types::P_BT_MASK;
+
+  // Runs until Halt() is called.
+  void Run() { Run(UINT64_MAX); }
+
+  // Runs until at least `budget` cycles have elapsed or Halt() is called,
+  // stopping at an instruction boundary. Returns the cycles executed.
+  uint64_t Run(uint64_t budget);
+
+  // Runs one instruction (including any interrupt taken before it).
+  // Returns the cycles used.
+  // A step runs even at an execute breakpoint.
+  uint32_t Step() {
+    const uint64_t start = cycles;
+    ClearBreak();
+    resumeCycle = cycles;
+    if (trace) { ExecuteTraced(); } else { Execute(); }
+    ++stateEpoch;
+    return static_cast<uint32_t>(cycles - start);
+  }
+
+  void Halt() { running = false; }
+
+  // Thread-safe: asks Run() to return at the next instruction boundary.
+  // If the CPU is not running, the request stops the next Run() or Step()
+  // before it executes anything.
+  void RequestHalt() { pending.fetch_or(HALT_REQUEST, std::memory_order_relaxed); }
+
+  // Total bus cycles executed since construction.
+  uint64_t Cycles() const { return cycles; }
+
+  enum INTERRUPT { NMI = 0, IRQ = 1, COUNT };
+
+  // Thread-safe: may be called from Load/Store or from any other thread.
+  // Ignored while replaying an InputLog.
+  void Signal(const INTERRUPT interrupt, bool value) {
+    if (replaying) { return; }
+    if (value) {
+      pending.fetch_or(1u << interrupt, std::memory_order_relaxed);
+    } else {
+      pending.fetch_and(~(1u << interrupt), std::memory_order_relaxed);
+    }
+  }
+
+  // Calls `callback` at the first instruction boundary at or after `cycle`.
+  // Events due on the same cycle run in the order they were scheduled.
+  // Returns an id that can be passed to Cancel().
+  uint32_t Schedule(uint64_t cycle, std::function<void()> callback);
+
+  // Asserts `interrupt` at the first instruction boundary at or after `cycle`.
+  uint32_t Schedule(uint64_t cycle, const INTERRUPT interrupt) {
+    return Schedule(cycle, [this, interrupt] { Signal(interrupt, true); });
+  }
+
+  void Cancel(uint32_t id);
+
+  void Reset() {
+    Core::Reset();
+    ++stateEpoch;
+  }
+
+  void OnUnknownOpcode(uint8_t) {}
+
+  // Architectural registers, with P as its packed byte.
+  struct Registers {
+    uint16_t PC;
+    uint8_t  A, X, Y, S, P;
+  };
+
+  Registers GetRegisters() const {
+    return { PC.w, A, X, Y, S, Status() };
+  }
+
+  void SetRegisters(const Registers &registers) {
+    ++idleEpoch;
+    ++stateEpoch;
+    PC.w = registers.PC;
+    A    = registers.A;
+    X    = registers.X;
+    Y    = registers.Y;
+    S    = registers.S;
+    SetStatus(registers.P);
+  }
+
+  // Save states use a fixed little-endian layout of STATE_SIZE bytes:
+  //   [0..3]   'M' '6' '5' STATE_VERSION
+  //   [4..5]   PC (low byte first)
+  //   [6..9]   reserved, zero (once the AB and TB latches)
+  //   [10..14] A, X, Y, S, P
+  //   [15]     interrupt lines (bit per INTERRUPT)
+  //   [16]     running
+  //   [17..24] cycle counter
+  //   [25..31] reserved, zero
+  // Scheduled events and page mappings belong to the host and are not saved.
+  // SaveState returns the bytes written and LoadState the bytes consumed, or
+  // 0 if the buffer is too small or not a compatible state, so a derived
+  // class can append its own state after the CPU's.
+  static constexpr size_t  STATE_SIZE    = 32;
+  static constexpr uint8_t STATE_VERSION = 1;
+
+  size_t SaveState(uint8_t *buffer, size_t size) const;
+  size_t LoadState(const uint8_t *buffer, size_t size);
+
+  // Maps whole 256-byte pages in [address, address + size) directly to host
+  // memory. Accesses to a mapped page bypass Load/Store; a null pointer sends
+  // that direction back to the bus. Both address and size must be multiples
+  // of 0x100. Leave a page unmapped if its accesses have side effects.
+  void MapPages(uint16_t address, uint32_t size, const uint8_t *read, uint8_t *write) {
+    for (uint32_t offset = 0; offset < size; offset += 0x100) {
+      const uint8_t page = static_cast<uint8_t>((address + offset) >> 8);
+      if (codeTracked[page]) { UnlinkCode(page); }
+      mappedPages -= (readPages[page] || shadowRead[page] || writePages[page] || protectedPages[page] || shadowWrite[page]);
+      mappedPages += (read || write);
+      readPages[page]      = read  ? read  + offset : nullptr;
+      writePages[page]     = write ? write + offset : nullptr;
+      protectedPages[page] = nullptr;
+      shadowRead[page]     = nullptr;
+      shadowWrite[page]    = nullptr;
+      codeGeneration[page]++;
+      if (readWatchCount[page] || writeWatchCount[page]) { ShadowPage(page); }
+      if (codeCacheEnabled) { JoinCode(page); }
+    }
+    ++idleEpoch;
+  }
+
+  void UnmapPages(uint16_t address, uint32_t size) {
+    MapPages(address, size, nullptr, nullptr);
+  }
+
+  // Optional predecoded code cache. Straight-line runs of official opcodes in
+  // mapped pages are decoded once into blocks keyed by PC and the page's
+  // backing memory (so bank switches miss rather than alias). Bus cycles are
+  // unchanged; only the opcode and operand fetches are skipped. A store through
+  // a mapped page that lands on cached code invalidates the blocks on that
+  // memory, mirrors included; hosts that modify mapped memory behind the
+  // core's back must call InvalidateCode(), which also covers the mirrors.
+  void EnableCodeCache(bool enable);
+  void InvalidateCode(uint16_t address, uint32_t size);
+
+  // Optional idle-loop fast-forward. When a backward branch or jump arrives
+  // back at its target in the same register state as last time, and the loop
+  // between them only reads mapped pages or addresses marked idempotent and
+  // never writes, Run() skips whole iterations up to the next scheduled event
+  // or the end of its budget, adding their exact cycles. An unbounded Run()
+  // with nothing scheduled has no such limit and does not skip. Reads of marked
+  // addresses must have no side effects, and their values may change only
+  // from events, interrupts or the host between Run() calls.
+  void EnableIdleSkip(bool enable) { idleSkipEnabled = enable; }
+  void MarkIdempotent(uint16_t address, uint32_t size);
+
+  // Records every instruction into `buffer` (see Trace.h) from the next Run()
+  // or Step(); nullptr stops. While tracing, Run() bypasses the code cache and
+  // threaded dispatch. Operand bytes are read with Load(address, true).
+  void SetTrace(TraceBuffer *buffer) { trace = buffer; }
+
+  // Appends the address and previous value of every store made through a
+  // mapped page to `journal` (see Journal.h); nullptr stops. Stores that reach
+  // Store() are not journaled: the host's own state covers them.
+  void SetJournal(StoreJournal *journal) { this->journal = journal; }
+
+  // Logs each interrupt taken, and the value of each read from an address the
+  // log marks nondeterministic, into `log` (see InputLog.h); nullptr stops.
+  // Marked addresses must stay unmapped while recording: returns false, and
+  // does not start, if one is in a mapped page.
+  bool Record(InputLog *log) {
+    if (log && MapsLoggedPage(*log)) { return false; }
+    inputLog  = log;
+    replaying = false;
+    UpdateHooks();
+    inputDeadline  = UINT64_MAX;
+    nextEventCycle = NextEventCycle();
+    return true;
+  }
+
+  // Takes interrupts and nondeterministic reads from `log`, from its start,
+  // instead of from Signal() and the bus; nullptr stops. The interrupt lines
+  // belong to the log until then. Reads past the end of the log go to the
+  // bus again. Like Record(), returns false if a marked address is mapped.
+  bool Replay(InputLog *log) {
+    if (log && MapsLoggedPage(*log)) { return false; }
+    if (log) { log->Rewind(); }
+    inputLog  = log;
+    replaying = (log != nullptr);
+    UpdateHooks();
+    pending.fetch_and(~((1u << INTERRUPT::NMI) | (1u << INTERRUPT::IRQ)), std::memory_order_relaxed);
+    inputDeadline  = log ? log->replayCycle : UINT64_MAX;
+    nextEventCycle = NextEventCycle();
+    return true;
+  }
+
+  // Debugger. An execute breakpoint stops Run() at the boundary before the
+  // instruction at its address, if its condition (when given) holds for the
+  // registers there; the next Run() or Step() then runs that instruction.
+  // A watchpoint stops Run() at the boundary after the instruction that read
+  // or wrote a watched address. Every bus access counts, including opcode
+  // fetches and dummy reads. Pages holding watched addresses leave the fast
+  // mapped path while watched. LastBreak() reports why the last Run() or
+  // Step() stopped, or BREAK_NONE. Change these only while the CPU is stopped
+  // or from its own callbacks.
+  enum BREAK { BREAK_NONE, BREAK_EXECUTE, BREAK_READ, BREAK_WRITE };
+
+  struct BreakInfo {
+    BREAK    cause   = BREAK_NONE;
+    uint16_t pc      = 0;  // of the instruction that hit it
+    uint16_t address = 0;
+    uint8_t  value   = 0;  // read or written, for watchpoints
+    uint64_t cycle   = 0;
+  };
+
+  using Condition = std::function<bool(const Registers &)>;
+
+  void SetBreakpoint(uint16_t address, Condition condition = nullptr);
+  void ClearBreakpoint(uint16_t address);
+  void SetWatchpoint(uint16_t address, uint32_t size, bool read, bool write);
+  void ClearWatchpoint(uint16_t address, uint32_t size);
+  void ClearBreakpoints();
+
+  const BreakInfo &LastBreak() const { return lastBreak; }
+
+protected:
+
+  // Only consulted when Variant::RUNTIME is set.
+  bool enableBCD = Variant::DECIMAL;
+  bool enableIllegal = Variant::ILLEGAL;
+
+private:
+
+  template <typename, size_t> friend class Lockstep;
+  template <typename> friend class Rewind;
+  template <typename, typename, bool> friend class MOS6502Core;
+
+  using Core  = MOS6502Core<Bus, Variant, false>;
+  using Local = MOS6502Core<Bus, Variant, true>;
+
+  using Op = MOS6502Types::Op;
+  using Core::OperandBytes;
+  using Core::PC;
+  using Core::A;
+  using Core::X;
+  using Core::Y;
+  using Core::S;
+  using Core::P;
+  using Core::cycles;
+  using Core::Status;
+  using Core::SetStatus;
+  using Core::Execute;
+  using Core::ExecuteTraced;
+
+  bool running = false;
+
+  // Bumped whenever the registers or the cycle counter change outside a
+  // running core, so a local core waiting on a callback knows to reload.
+  uint32_t stateEpoch = 0;
+
+  struct Event {
+    uint64_t cycle;
+    uint32_t id;
+    std::function<void()> callback;
+
+    // Ordered so the event heap keeps the earliest (then oldest) on top.
+    bool operator<(const Event &other) const {
+      return (cycle != other.cycle) ? cycle > other.cycle : id > other.id;
+    }
+  };
+
+  std::vector<Event> events;
+  uint32_t nextEventId = 0;
+  uint64_t nextEventCycle = UINT64_MAX;
+
+  [[gnu::noinline]] void RunEvents();
+
+  uint64_t NextEventCycle() const {
+    return std::min(events.empty() ? UINT64_MAX : events.front().cycle, inputDeadline);
+  }
+
+  // Interrupt lines (bit per INTERRUPT), the halt request and the debugger
+  // flags, in one word so Execute() can poll all of them with a single
+  // relaxed load. DEBUG_ARMED stays set while any breakpoint or watchpoint
+  // exists; DEBUG_STOP is raised by a watchpoint hit.
+  static constexpr uint32_t LINES        = (1u << INTERRUPT::COUNT) - 1;
+  static constexpr uint32_t HALT_REQUEST = 1u << INTERRUPT::COUNT;
+  static constexpr uint32_t DEBUG_ARMED  = HALT_REQUEST << 1;
+  static constexpr uint32_t DEBUG_STOP   = HALT_REQUEST << 2;
+
+  std::atomic<uint32_t> pending = 0;
+
+  std::array<const uint8_t *, 0x100> readPages  = {};
+  std::array<uint8_t *, 0x100>       writePages = {};
+  uint32_t mappedPages = 0;
+
+  // Write pointers of pages holding cached code, moved out of writePages so
+  // stores to them reach InvalidateCodeAt().
+  std::array<uint8_t *, 0x100> protectedPages = {};
+  std::array<uint32_t, 0x100>  codeGeneration = {};
+
+  // Pages holding cached code, and every page whose reads map the same
+  // memory, are tracked: linked in a ring through codeMirror and protected
+  // once, when the first block is decoded. codeBytes marks the bytes each
+  // page's blocks were decoded from, so a store only invalidates the ring
+  // when it lands on one of them in any of its pages.
+  std::array<bool, 0x100>    codeTracked = {};
+  std::array<uint8_t, 0x100> codeMirror  = {};
+  std::array<std::array<uint64_t, 4>, 0x100> codeBytes = {};
+
+  struct Block {
+    static constexpr uint8_t MAX_OPS = 16;
+
+    const uint8_t *memory = nullptr;
+    uint32_t generation = 0;
+    uint16_t pc = 0;
+    uint8_t  count = 0;
+    Op       ops[MAX_OPS] = {};
+  };
+
+  static constexpr size_t CODE_CACHE_SIZE = 1024;
+
+  bool codeCacheEnabled = false;
+  std::vector<Block> codeCache;
+
+  // Branches, jumps, calls, returns and BRK end a block.
+  static constexpr bool EndsBlock(uint8_t opcode) {
+    return (opcode & 0x1F) == 0x10
+        || opcode == 0x00 || opcode == 0x20 || opcode == 0x40
+        || opcode == 0x4C || opcode == 0x60 || opcode == 0x6C;
+  }
+
+  inline const Block *FindBlock(uint16_t pc);
+  [[gnu::noinline]] const Block *DecodeBlock(Block &block, uint16_t pc);
+  [[gnu::noinline]] void InvalidateCodeAt(uint16_t address);
+
+  const uint8_t *CodeMemory(uint8_t page) const {
+    return readPages[page] ? readPages[page] : shadowRead[page];
+  }
+
+  void TrackCode(uint8_t page);
+  void UntrackCode(uint8_t page);
+  void LinkCode(uint8_t page, uint8_t ring);
+  void UnlinkCode(uint8_t page);
+  void JoinCode(uint8_t page);
+
+  // The last backward branch or jump taken and the state it arrived with.
+  // Anything that may change memory or control flow from outside a loop
+  // (events, interrupts, mappings, register writes, a new Run()) bumps
+  // idleEpoch, so the loop has to be observed again before it is skipped.
+  struct IdleLoop {
+    uint16_t  branch = 0;
+    uint16_t  target = 0;
+    uint32_t  epoch = UINT32_MAX;
+    uint64_t  cycles = 0;
+    Registers registers = {};
+    bool      idle = false;
+  };
+
+  // Longest loop, in instructions, that IsIdleLoop() will consider.
+  static constexpr size_t IDLE_LOOP_LENGTH = 16;
+
+  bool idleSkipEnabled = false;
+  uint32_t idleEpoch = 0;
+  uint64_t runEnd = 0;
+  IdleLoop idleLoop;
+  std::vector<uint64_t> idempotent;
+
+  TraceBuffer  *trace = nullptr;
+  StoreJournal *journal = nullptr;
+
+  // Recording or replaying; while replaying, inputDeadline is the next cycle
+  // RunEvents() has to raise or drop an interrupt line for the log.
+  InputLog *inputLog = nullptr;
+  bool      replaying = false;
+  uint64_t  inputDeadline = UINT64_MAX;
+
+  void ReplayInterrupts();
+
+  // Whether a page holding an address `log` marks is mapped, watched or not.
+  bool MapsLoggedPage(const InputLog &log) const {
+    for (int page = 0; page < 0x100; page++) {
+      if ((readPages[page] || shadowRead[page]) && log.MarksPage(static_cast<uint8_t>(page))) { return true; }
+    }
+    return false;
+  }
+
+  // Debugger state. Bitmaps are allocated on first use. Pages holding
+  // watched addresses have their pointers moved into shadowRead/shadowWrite
+  // so accesses reach LoadHooked()/StoreHooked().
+  std::vector<uint64_t> breakpoints;
+  std::vector<uint64_t> readWatch;
+  std::vector<uint64_t> writeWatch;
+  std::unordered_map<uint16_t, Condition> conditions;
+
+  uint32_t breakpointCount = 0;
+  uint32_t readWatchTotal  = 0;
+  uint32_t writeWatchTotal = 0;
+  std::array<uint16_t, 0x100> readWatchCount  = {};
+  std::array<uint16_t, 0x100> writeWatchCount = {};
+  std::array<const uint8_t *, 0x100> shadowRead  = {};
+  std::array<uint8_t *, 0x100>       shadowWrite = {};
+
+  BreakInfo lastBreak;
+  uint16_t  instructionPC = 0;
+  uint64_t  resumeCycle = UINT64_MAX;  // boundary a breakpoint last stopped at
+
+  // Accesses that must leave the fast path: the input log or watchpoints.
+  bool readHooks  = false;
+  bool writeHooks = false;
+
+  void UpdateHooks() {
+    readHooks  = inputLog || readWatchTotal;
+    writeHooks = writeWatchTotal != 0;
+    if (breakpointCount || readWatchTotal || writeWatchTotal) {
+      pending.fetch_or(DEBUG_ARMED, std::memory_order_relaxed);
+    } else {
+      pending.fetch_and(~DEBUG_ARMED, std::memory_order_relaxed);
+    }
+  }
+
+  void ClearBreak() {
+    lastBreak = {};
+    pending.fetch_and(~DEBUG_STOP, std::memory_order_relaxed);
+  }
+
+  static bool TestBit(const std::vector<uint64_t> &bitmap, uint16_t address) {
+    return !bitmap.empty() && ((bitmap[address >> 6] >> (address & 63)) & 1);
+  }
+
+  void ShadowPage(uint8_t page);
+  void UnshadowPage(uint8_t page);
+  [[gnu::cold, gnu::noinline]] bool CheckBreak();
+  [[gnu::cold, gnu::noinline]] uint8_t LoadHooked(uint16_t address);
+  [[gnu::cold, gnu::noinline]] void StoreHooked(uint16_t address, uint8_t value);
+  void Watch(BREAK cause, uint16_t address, uint8_t value);
+
+  [[gnu::noinline]] void LoopBack(uint16_t branch, uint16_t target);
+  bool IsIdleLoop(uint16_t target, uint16_t branch);
+  bool IsIdempotent(uint16_t address) const;
+  uint8_t Peek(uint16_t address);
+
+  inline Bus &bus() {
+    return static_cast<Bus &>(*this);
+  }
+
+  // Puts back a journaled byte through the current mapping.
+  void Restore(uint16_t address, uint8_t value) {
+    if (uint8_t *page = writePages[address >> 8]) { page[address & 0xFF] = value; return; }
+    if (uint8_t *page = protectedPages[address >> 8] ? protectedPages[address >> 8] : shadowWrite[address >> 8]) {
+      page[address & 0xFF] = value;
+      InvalidateCodeAt(address);
+    }
+  }
+
+  inline bool DecimalEnabled() const {
+    return Variant::RUNTIME ? enableBCD : Variant::DECIMAL;
+  }
+
+  inline bool IllegalEnabled() const {
+    return Variant::RUNTIME ? enableIllegal : Variant::ILLEGAL;
+  }
+
+  // Run() on a local core, once any page is mapped. With MOS6502_FLATTEN,
+  // every call it makes is inlined into this one function.
+#if MOS6502_FLATTEN
+  [[gnu::flatten]]
+#endif
+  void RunLocal(uint64_t end) {
+    Local local(*this);
+    local.Run(end);
+    local.Leave();
+  }
+
+};
+
+#include "MOS6502/MOS6502T.inl"
+#include "MOS6502/MOS6502T_illegal.inl"
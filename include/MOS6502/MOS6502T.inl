@@ -0,0 +1,1154 @@
+//
+// MOS6502T.inl
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+
+template <typename Bus, typename Variant>
+uint64_t MOS6502T<Bus, Variant>::Run(uint64_t budget) {
+  const uint64_t start = cycles;
+  const uint64_t end   = (budget > UINT64_MAX - start) ? UINT64_MAX : start + budget;
+
+  running = true;
+  runEnd  = end;
+  ++idleEpoch;
+  ClearBreak();
+
+  if (trace) {
+    while (running && cycles < end) { ExecuteTraced(); }
+  } else if (mappedPages) {
+    RunLocal(end);
+  } else {
+    Core::Run(end);
+  }
+  ++stateEpoch;
+
+  runEnd = 0;
+  return cycles - start;
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::Run(uint64_t end) {
+  while (cpu().running && cycles < end) {
+#if MOS6502_COMPUTED_GOTO
+    // Threaded dispatch has no per-instruction hook for the profiler.
+    if (!Variant::PROFILE && !cpu().codeCacheEnabled) {
+      RunThreaded(end);
+      continue;
+    }
+#endif
+    if (!Poll()) { return; }
+    if (cpu().codeCacheEnabled && ExecuteBlock(end)) { continue; }
+    Instruction();
+  }
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::Execute() {
+  if (Poll()) { Instruction(); }
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ExecuteTraced() {
+  if (!Poll()) { return; }
+
+  const uint16_t pc     = PC.w;
+  const uint64_t start  = cycles;
+  const BYTE     opcode = Fetch();
+
+  TraceRecord record = { start, pc, opcode, {}, A, X, Y, Status(), S };
+  Leave();
+  for (uint8_t index = 1; index < OPCODE_INFO[opcode].size; index++) {
+    record.operand[index - 1] = cpu().Peek(static_cast<uint16_t>(pc + index));
+  }
+  Enter();
+  cpu().trace->Record(record);
+
+  if constexpr (Variant::PROFILE) { cpu().ProfileBegin(pc, opcode, start); }
+  Dispatch(opcode);
+  if constexpr (Variant::PROFILE) { cpu().ProfileEnd(cycles); }
+}
+
+// Dispatch(Fetch()), wrapped in the Profiler hooks when Variant::PROFILE is
+// set.
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::Instruction() {
+  if constexpr (Variant::PROFILE) {
+    const uint16_t pc     = PC.w;
+    const uint64_t start  = cycles;
+    const BYTE     opcode = Fetch();
+    cpu().ProfileBegin(pc, opcode, start);
+    Dispatch(opcode);
+    cpu().ProfileEnd(cycles);
+  } else {
+    Dispatch(Fetch());
+  }
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+bool MOS6502Core<Bus, Variant, LOCAL>::Poll() {
+  if (cycles >= cpu().nextEventCycle) {
+    Leave();
+    cpu().RunEvents();
+    Resume();
+  }
+
+  if (const uint32_t lines = cpu().pending.load(std::memory_order_relaxed)) {
+
+    if (lines & CPU::HALT_REQUEST) {
+      cpu().pending.fetch_and(~CPU::HALT_REQUEST, std::memory_order_relaxed);
+      cpu().running = false;
+      return false;
+    }
+
+    if (lines & (CPU::DEBUG_ARMED | CPU::DEBUG_STOP)) {
+      Leave();
+      const bool go = cpu().CheckBreak();
+      Resume();
+      if (!go) { return false; }
+    }
+
+    // NMI is edge-triggered; clear the latch on acknowledge.
+    if (lines & (1u << CPU::INTERRUPT::NMI)) {
+      cpu().pending.fetch_and(~(1u << CPU::INTERRUPT::NMI), std::memory_order_relaxed);
+      if (cpu().inputLog && !cpu().replaying) { cpu().inputLog->RecordInterrupt(cycles, InputLog::NMI); }
+      DispatchInterrupt(0xFFFA);
+    }
+
+    // IRQ is level-triggered; the device de-asserts it, not the CPU.
+    else if (!P.I && (lines & (1u << CPU::INTERRUPT::IRQ))) {
+      if (cpu().inputLog && !cpu().replaying) { cpu().inputLog->RecordInterrupt(cycles, InputLog::IRQ); }
+      DispatchInterrupt(0xFFFE);
+    }
+  }
+
+  return true;
+}
+
+//
+// Opcode Dispatch
+//
+
+// How each OpcodeTable.inc kind runs its body, after fetching its operand.
+#define MOS6502_OFFICIAL(opcode, mode, ...) \
+  { [[maybe_unused]] const WORD operand = FetchOperand<OperandBytes(opcode, OpcodeInfo::mode)>(); __VA_ARGS__; }
+#define MOS6502_ILLEGAL(opcode, mode, ...)  if (cpu().IllegalEnabled()) MOS6502_OFFICIAL(opcode, mode, __VA_ARGS__) else { Unknown(opcode); }
+#define MOS6502_UNKNOWN(opcode, mode, ...)  Unknown(opcode);
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::Dispatch(BYTE opcode) {
+  switch (opcode) {
+#define OPCODE(opcode, mnemonic, mode, base, kind, effect, ...) \
+    case opcode: MOS6502_##kind(opcode, mode, __VA_ARGS__) break;
+#include "MOS6502/OpcodeTable.inc"
+#undef OPCODE
+  }
+}
+
+// The same bodies for an instruction FindBlock() has already fetched. Only
+// official opcodes are cached.
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::DispatchDecoded(const Op &op) {
+  cycles += op.cycles;
+  PC.w   += op.cycles;
+  [[maybe_unused]] const WORD operand = op.operand;
+
+  switch (op.opcode) {
+#define MOS6502_DECODED_OFFICIAL(...) { __VA_ARGS__; }
+#define MOS6502_DECODED_ILLEGAL(...)
+#define MOS6502_DECODED_UNKNOWN(...)
+#define OPCODE(opcode, mnemonic, mode, base, kind, effect, ...) \
+    case opcode: MOS6502_DECODED_##kind(__VA_ARGS__) break;
+#include "MOS6502/OpcodeTable.inc"
+#undef OPCODE
+#undef MOS6502_DECODED_OFFICIAL
+#undef MOS6502_DECODED_ILLEGAL
+#undef MOS6502_DECODED_UNKNOWN
+  }
+}
+
+#if MOS6502_COMPUTED_GOTO
+
+// Every handler ends with its own poll and indirect jump to the next opcode,
+// giving the branch predictor one dispatch site per opcode instead of one
+// shared switch. Returns at the same boundaries as the Execute() loop.
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::RunThreaded(uint64_t end) {
+  static const void *const handlers[0x100] = {
+#define OPCODE(opcode, ...) &&op_##opcode,
+#include "MOS6502/OpcodeTable.inc"
+#undef OPCODE
+  };
+
+#define MOS6502_NEXT \
+  if (!cpu().running || cycles >= end || cpu().codeCacheEnabled || !Poll()) { return; } \
+  goto *handlers[Fetch()];
+
+  MOS6502_NEXT
+#define OPCODE(opcode, mnemonic, mode, base, kind, effect, ...) \
+  op_##opcode: MOS6502_##kind(opcode, mode, __VA_ARGS__) MOS6502_NEXT
+#include "MOS6502/OpcodeTable.inc"
+#undef OPCODE
+#undef MOS6502_NEXT
+}
+
+#endif
+
+#undef MOS6502_OFFICIAL
+#undef MOS6502_ILLEGAL
+#undef MOS6502_UNKNOWN
+
+//
+// Scheduler
+//
+
+template <typename Bus, typename Variant>
+uint32_t MOS6502T<Bus, Variant>::Schedule(uint64_t cycle, std::function<void()> callback) {
+  const uint32_t id = nextEventId++;
+  events.push_back({ cycle, id, std::move(callback) });
+  std::push_heap(events.begin(), events.end());
+  nextEventCycle = NextEventCycle();
+  return id;
+}
+
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::Cancel(uint32_t id) {
+  auto it = std::find_if(events.begin(), events.end(), [id](const Event &event) { return event.id == id; });
+  if (it == events.end()) { return; }
+
+  events.erase(it);
+  std::make_heap(events.begin(), events.end());
+  nextEventCycle = NextEventCycle();
+}
+
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::RunEvents() {
+  while (!events.empty() && events.front().cycle <= cycles) {
+    std::pop_heap(events.begin(), events.end());
+    Event event = std::move(events.back());
+    events.pop_back();
+    nextEventCycle = NextEventCycle();
+    ++idleEpoch;
+
+    // The callback may schedule or cancel events, so it runs last.
+    event.callback();
+  }
+
+  if (replaying && cycles >= inputDeadline) {
+    ReplayInterrupts();
+  }
+}
+
+//
+// Input Record and Replay
+//
+
+// Raises the line for each logged interrupt at the boundary it was taken on,
+// and drops it again at the next one.
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::ReplayInterrupts() {
+  pending.fetch_and(~((1u << INTERRUPT::NMI) | (1u << INTERRUPT::IRQ)), std::memory_order_relaxed);
+  inputDeadline = inputLog->replayCycle;
+
+  if (inputLog->replayCycle <= cycles) {
+    pending.fetch_or(1u << (inputLog->replayKind == InputLog::NMI ? INTERRUPT::NMI : INTERRUPT::IRQ), std::memory_order_relaxed);
+    inputLog->Decode();
+    inputDeadline = cycles + 1;
+  }
+
+  nextEventCycle = NextEventCycle();
+  ++idleEpoch;
+}
+
+//
+// Debugger
+//
+
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::SetBreakpoint(uint16_t address, Condition condition) {
+  if (breakpoints.empty()) { breakpoints.resize(0x10000 / 64); }
+  uint64_t &word = breakpoints[address >> 6];
+  const uint64_t bit = uint64_t(1) << (address & 63);
+  if (!(word & bit)) {
+    word |= bit;
+    breakpointCount++;
+  }
+
+  if (condition) {
+    conditions[address] = std::move(condition);
+  } else {
+    conditions.erase(address);
+  }
+  UpdateHooks();
+}
+
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::ClearBreakpoint(uint16_t address) {
+  if (TestBit(breakpoints, address)) {
+    breakpoints[address >> 6] &= ~(uint64_t(1) << (address & 63));
+    breakpointCount--;
+  }
+  conditions.erase(address);
+  UpdateHooks();
+}
+
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::SetWatchpoint(uint16_t address, uint32_t size, bool read, bool write) {
+  if (read  && readWatch.empty())  { readWatch.resize(0x10000 / 64); }
+  if (write && writeWatch.empty()) { writeWatch.resize(0x10000 / 64); }
+
+  for (uint32_t offset = 0; offset < size; offset++) {
+    const uint16_t watched = static_cast<uint16_t>(address + offset);
+    const uint8_t  page    = watched >> 8;
+    const uint64_t bit     = uint64_t(1) << (watched & 63);
+
+    if (read && !(readWatch[watched >> 6] & bit)) {
+      readWatch[watched >> 6] |= bit;
+      readWatchTotal++;
+      readWatchCount[page]++;
+    }
+    if (write && !(writeWatch[watched >> 6] & bit)) {
+      writeWatch[watched >> 6] |= bit;
+      writeWatchTotal++;
+      writeWatchCount[page]++;
+    }
+    ShadowPage(page);
+  }
+  UpdateHooks();
+}
+
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::ClearWatchpoint(uint16_t address, uint32_t size) {
+  for (uint32_t offset = 0; offset < size; offset++) {
+    const uint16_t watched = static_cast<uint16_t>(address + offset);
+    const uint8_t  page    = watched >> 8;
+    const uint64_t bit     = uint64_t(1) << (watched & 63);
+
+    if (TestBit(readWatch, watched)) {
+      readWatch[watched >> 6] &= ~bit;
+      readWatchTotal--;
+      readWatchCount[page]--;
+    }
+    if (TestBit(writeWatch, watched)) {
+      writeWatch[watched >> 6] &= ~bit;
+      writeWatchTotal--;
+      writeWatchCount[page]--;
+    }
+    UnshadowPage(page);
+  }
+  UpdateHooks();
+}
+
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::ClearBreakpoints() {
+  ClearWatchpoint(0x0000, 0x10000);
+  std::fill(breakpoints.begin(), breakpoints.end(), 0);
+  breakpointCount = 0;
+  conditions.clear();
+  UpdateHooks();
+}
+
+// Moves a watched page's pointers out of the fast path.
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::ShadowPage(uint8_t page) {
+  if (readWatchCount[page] && readPages[page]) {
+    shadowRead[page] = readPages[page];
+    readPages[page]  = nullptr;
+  }
+  if (writeWatchCount[page]) {
+    if (writePages[page]) {
+      shadowWrite[page] = writePages[page];
+      writePages[page]  = nullptr;
+    } else if (protectedPages[page]) {
+      shadowWrite[page]     = protectedPages[page];
+      protectedPages[page]  = nullptr;
+    }
+  }
+}
+
+// Puts an unwatched page's pointers back.
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::UnshadowPage(uint8_t page) {
+  if (!readWatchCount[page] && shadowRead[page]) {
+    readPages[page]  = shadowRead[page];
+    shadowRead[page] = nullptr;
+  }
+  if (!writeWatchCount[page] && shadowWrite[page]) {
+    // A page still holding cached code stays write-protected.
+    if (codeTracked[page]) {
+      protectedPages[page] = shadowWrite[page];
+    } else {
+      writePages[page] = shadowWrite[page];
+    }
+    shadowWrite[page] = nullptr;
+  }
+}
+
+// Called from Poll() while anything is armed. Returns false to stop.
+template <typename Bus, typename Variant>
+bool MOS6502T<Bus, Variant>::CheckBreak() {
+  if (pending.load(std::memory_order_relaxed) & DEBUG_STOP) {
+    pending.fetch_and(~DEBUG_STOP, std::memory_order_relaxed);
+    running = false;
+    return false;
+  }
+
+  instructionPC = PC.w;
+
+  if (cycles != resumeCycle && TestBit(breakpoints, PC.w)) {
+    const auto it = conditions.find(PC.w);
+    if (it == conditions.end() || it->second(GetRegisters())) {
+      lastBreak   = { BREAK_EXECUTE, PC.w, PC.w, 0, cycles };
+      resumeCycle = cycles;
+      running     = false;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::Watch(BREAK cause, uint16_t address, uint8_t value) {
+  if (lastBreak.cause == BREAK_NONE) {
+    lastBreak = { cause, instructionPC, address, value, cycles };
+  }
+  pending.fetch_or(DEBUG_STOP, std::memory_order_relaxed);
+}
+
+// Unmapped reads while logging input or watching reads.
+template <typename Bus, typename Variant>
+uint8_t MOS6502T<Bus, Variant>::LoadHooked(uint16_t address) {
+  uint8_t value;
+
+  if (const uint8_t *page = shadowRead[address >> 8]) {
+    value = page[address & 0xFF];
+  } else if (!inputLog || !inputLog->IsNondeterministic(address)) {
+    value = bus().Load(address);
+  } else if (replaying) {
+    if (!inputLog->ReplayValue(value)) { value = bus().Load(address); }
+  } else {
+    value = bus().Load(address);
+    inputLog->RecordValue(value);
+  }
+
+  if (TestBit(readWatch, address)) { Watch(BREAK_READ, address, value); }
+  return value;
+}
+
+// Unmapped writes while watching writes.
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::StoreHooked(uint16_t address, uint8_t value) {
+  if (TestBit(writeWatch, address)) { Watch(BREAK_WRITE, address, value); }
+
+  if (uint8_t *page = shadowWrite[address >> 8]) {
+    if (journal) { journal->Append(address, page[address & 0xFF]); }
+    page[address & 0xFF] = value;
+    InvalidateCodeAt(address);
+    return;
+  }
+
+  bus().Store(address, value);
+}
+
+//
+// Code Cache
+//
+
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::EnableCodeCache(bool enable) {
+  if (enable && codeCache.empty()) {
+    codeCache.resize(CODE_CACHE_SIZE);
+  }
+  // Put every page back on the fast path.
+  if (!enable) { InvalidateCode(0x0000, 0x10000); }
+  codeCacheEnabled = enable;
+}
+
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::InvalidateCode(uint16_t address, uint32_t size) {
+  for (uint32_t offset = 0; offset < size; offset += 0x100) {
+    const uint8_t page = static_cast<uint8_t>((address + offset) >> 8);
+    codeGeneration[page]++;
+    if (codeTracked[page]) { UntrackCode(page); }
+  }
+}
+
+// A store landed on a tracked page. Only one that hits a byte some block was
+// decoded from, in this page or a mirror of it, makes blocks stale.
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::InvalidateCodeAt(uint16_t address) {
+  const uint8_t page = address >> 8;
+  if (!codeTracked[page]) { return; }
+
+  const uint8_t  offset = address & 0xFF;
+  const uint64_t bit    = uint64_t(1) << (offset & 63);
+  uint8_t member = page;
+  do {
+    if (codeBytes[member][offset >> 6] & bit) {
+      UntrackCode(page);
+      return;
+    }
+    member = codeMirror[member];
+  } while (member != page);
+}
+
+// Tracks the first page of some memory to hold cached code, with every page
+// that reads the same memory.
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::TrackCode(uint8_t page) {
+  const uint8_t *memory = CodeMemory(page);
+  codeMirror[page] = page;
+  LinkCode(page, page);
+  for (int other = 0; other < 0x100; other++) {
+    if (other != page && CodeMemory(static_cast<uint8_t>(other)) == memory) {
+      LinkCode(static_cast<uint8_t>(other), page);
+    }
+  }
+}
+
+// Invalidates every block cached in the ring holding `page`, and puts its
+// pages back on the fast path.
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::UntrackCode(uint8_t page) {
+  uint8_t member = page;
+  do {
+    const uint8_t next = codeMirror[member];
+    codeGeneration[member]++;
+    codeBytes[member]   = {};
+    codeTracked[member] = false;
+    codeMirror[member]  = member;
+    if (protectedPages[member]) {
+      writePages[member]     = protectedPages[member];
+      protectedPages[member] = nullptr;
+    }
+    member = next;
+  } while (member != page);
+}
+
+// Adds `page` to the ring after `ring` and write-protects it.
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::LinkCode(uint8_t page, uint8_t ring) {
+  codeTracked[page] = true;
+  codeMirror[page]  = codeMirror[ring];
+  codeMirror[ring]  = page;
+  if (writePages[page]) {
+    protectedPages[page] = writePages[page];
+    writePages[page]     = nullptr;
+  }
+}
+
+// Takes a page that is being remapped out of its ring, leaving the blocks
+// cached in the other pages alone.
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::UnlinkCode(uint8_t page) {
+  uint8_t previous = page;
+  while (codeMirror[previous] != page) { previous = codeMirror[previous]; }
+  codeMirror[previous] = codeMirror[page];
+  codeMirror[page]     = page;
+  codeBytes[page]      = {};
+  codeTracked[page]    = false;
+}
+
+// A page just mapped to memory that already holds cached code joins its
+// ring, so stores through it invalidate that code too.
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::JoinCode(uint8_t page) {
+  const uint8_t *memory = CodeMemory(page);
+  if (!memory) { return; }
+  for (int other = 0; other < 0x100; other++) {
+    if (other != page && codeTracked[other] && CodeMemory(static_cast<uint8_t>(other)) == memory) {
+      LinkCode(page, static_cast<uint8_t>(other));
+      return;
+    }
+  }
+}
+
+template <typename Bus, typename Variant>
+const typename MOS6502T<Bus, Variant>::Block *MOS6502T<Bus, Variant>::FindBlock(uint16_t pc) {
+  const uint8_t page = pc >> 8;
+  const uint8_t *memory = readPages[page];
+  if (!memory) { return nullptr; }
+
+  Block &block = codeCache[pc & (CODE_CACHE_SIZE - 1)];
+  if (block.memory == memory && block.pc == pc && block.generation == codeGeneration[page] && block.count) {
+    return &block;
+  }
+
+  return DecodeBlock(block, pc);
+}
+
+// Refills `block` from the mapped memory at `pc`.
+template <typename Bus, typename Variant>
+const typename MOS6502T<Bus, Variant>::Block *MOS6502T<Bus, Variant>::DecodeBlock(Block &block, uint16_t pc) {
+  const uint8_t page = pc >> 8;
+  const uint8_t *memory = readPages[page];
+
+  block.memory     = memory;
+  block.pc         = pc;
+  block.generation = codeGeneration[page];
+  block.count      = 0;
+
+  // Decode a straight-line run that stays inside this page.
+  unsigned offset = pc & 0xFF;
+  while (block.count < Block::MAX_OPS) {
+    const uint8_t opcode = memory[offset];
+    const OpcodeInfo &info = OPCODE_INFO[opcode];
+    if (info.kind != OpcodeInfo::OFFICIAL || offset + info.size > 0x100) { break; }
+
+    Op &op = block.ops[block.count++];
+    op.opcode    = opcode;
+    op.cycles    = 1 + OperandBytes(opcode, info.mode);
+    op.operand.w = 0;
+    if (op.cycles > 1) { op.operand.l = memory[offset + 1]; }
+    if (op.cycles > 2) { op.operand.h = memory[offset + 2]; }
+    offset += info.size;
+
+    if (EndsBlock(opcode)) { break; }
+  }
+
+  if (!block.count) { return nullptr; }
+
+  // Mark the decoded bytes, and the first time write-protect every page
+  // backed by this memory so stores to them take the slow path in Write().
+  for (unsigned byte = pc & 0xFF; byte < offset; byte++) {
+    codeBytes[page][byte >> 6] |= uint64_t(1) << (byte & 63);
+  }
+  if (!codeTracked[page]) { TrackCode(page); }
+
+  return &block;
+}
+
+// Runs the block at PC, once Poll() has let the next instruction start.
+// Returns false if that instruction still has to run the normal way: there
+// is no block, or an interrupt was taken inside one and its handler's first
+// instruction is next, so the run still ends on a boundary.
+template <typename Bus, typename Variant, bool LOCAL>
+bool MOS6502Core<Bus, Variant, LOCAL>::ExecuteBlock(uint64_t end) {
+  const typename CPU::Block *block = cpu().FindBlock(PC.w);
+  if (!block) { return false; }
+
+  const uint8_t  page       = block->pc >> 8;
+  const uint32_t generation = block->generation;
+
+  for (const Op *op = block->ops, *last = op + block->count; ; ) {
+    // The fetches read a mapped page, so only their cycles are observable.
+    if constexpr (Variant::PROFILE) { cpu().ProfileBegin(PC.w, op->opcode, cycles); }
+    DispatchDecoded(*op);
+    if constexpr (Variant::PROFILE) { cpu().ProfileEnd(cycles); }
+
+    if (++op == last || cpu().codeGeneration[page] != generation || !cpu().running || cycles >= end) {
+      return true;
+    }
+
+    const uint16_t next = PC.w;
+    if (!Poll()) { return true; }
+    if (PC.w != next) { return false; }
+  }
+}
+
+//
+// Idle Loops
+//
+
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::MarkIdempotent(uint16_t address, uint32_t size) {
+  if (idempotent.empty()) {
+    idempotent.resize(0x10000 / 64);
+  }
+  for (uint32_t offset = 0; offset < size; offset++) {
+    const uint16_t marked = static_cast<uint16_t>(address + offset);
+    idempotent[marked >> 6] |= uint64_t(1) << (marked & 63);
+  }
+  ++idleEpoch;
+}
+
+template <typename Bus, typename Variant>
+bool MOS6502T<Bus, Variant>::IsIdempotent(uint16_t address) const {
+  if (readPages[address >> 8]) { return true; }
+  return !idempotent.empty() && ((idempotent[address >> 6] >> (address & 63)) & 1);
+}
+
+template <typename Bus, typename Variant>
+uint8_t MOS6502T<Bus, Variant>::Peek(uint16_t address) {
+  if (const uint8_t *page = readPages[address >> 8]) { return page[address & 0xFF]; }
+  if (const uint8_t *page = shadowRead[address >> 8]) { return page[address & 0xFF]; }
+  return bus().Load(address, true);
+}
+
+// Called once a backward branch or jump at `branch` has landed on `target`.
+template <typename Bus, typename Variant>
+void MOS6502T<Bus, Variant>::LoopBack(uint16_t branch, uint16_t target) {
+  const Registers registers = GetRegisters();
+
+  if (idleLoop.epoch != idleEpoch || idleLoop.branch != branch || idleLoop.target != target) {
+    idleLoop = { branch, target, idleEpoch, cycles, registers, IsIdleLoop(target, branch) };
+    return;
+  }
+
+  const Registers &last = idleLoop.registers;
+  const bool same = registers.PC == last.PC && registers.A == last.A && registers.X == last.X
+                 && registers.Y  == last.Y  && registers.S == last.S && registers.P == last.P;
+
+  // Nothing the loop reads has changed, so every further iteration repeats
+  // this one until an event or interrupt intervenes.
+  const uint32_t lines = pending.load(std::memory_order_relaxed);
+  const bool interrupt = (lines & (HALT_REQUEST | DEBUG_ARMED | (1u << INTERRUPT::NMI)))
+                      || (!P.I && (lines & (1u << INTERRUPT::IRQ)));
+
+  if (idleLoop.idle && same && !interrupt) {
+    const uint64_t period = cycles - idleLoop.cycles;
+    const uint64_t limit  = std::min(nextEventCycle, runEnd);
+    // With no event and no budget there is nothing to skip to: leave the
+    // counter alone and keep looping until Halt() or an interrupt.
+    if (period && limit != UINT64_MAX && limit > cycles) {
+      cycles += (limit - cycles) / period * period;
+    }
+  }
+
+  idleLoop.cycles    = cycles;
+  idleLoop.registers = registers;
+}
+
+// Whether the code from target through the branch at `branch` can only
+// read idempotent memory and branch within itself: no stores, stack or
+// subroutine use, and no indexed or indirect operands. The opcode table's
+// effect column decides which instructions qualify. Inner branches must
+// land on an instruction the scan decoded, so a branch into the middle of
+// one cannot run bytes the scan never looked at.
+template <typename Bus, typename Variant>
+bool MOS6502T<Bus, Variant>::IsIdleLoop(uint16_t target, uint16_t branch) {
+  std::array<uint16_t, IDLE_LOOP_LENGTH> starts;
+  std::array<uint16_t, IDLE_LOOP_LENGTH> landings;
+  size_t startCount   = 0;
+  size_t landingCount = 0;
+
+  const auto landsOnStarts = [&] {
+    for (size_t landing = 0; landing < landingCount; landing++) {
+      if (std::find(starts.begin(), starts.begin() + startCount, landings[landing]) == starts.begin() + startCount) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  for (uint32_t pc = target; pc <= branch; ) {
+    if (startCount == IDLE_LOOP_LENGTH) { return false; }
+    starts[startCount++] = static_cast<uint16_t>(pc);
+
+    const uint8_t     opcode = Peek(pc);
+    const OpcodeInfo &info   = OPCODE_INFO[opcode];
+    if (info.kind != OpcodeInfo::OFFICIAL) { return false; }
+
+    for (uint32_t offset = 0; offset < info.size; offset++) {
+      if (!IsIdempotent(pc + offset)) { return false; }
+    }
+
+    const uint16_t operand = (info.size == 3) ? (Peek(pc + 1) | (Peek(pc + 2) << 8)) : Peek(pc + 1);
+
+    switch (info.mode) {
+      case OpcodeInfo::IMP:
+      case OpcodeInfo::ACC:
+        if (info.effect != OpcodeInfo::NONE) { return false; }
+        break;
+
+      case OpcodeInfo::IMM:
+        break;
+
+      case OpcodeInfo::ZPG:
+      case OpcodeInfo::ABS:
+        if (pc == branch && opcode == 0x4C) { return operand == target && landsOnStarts(); }
+        if (info.effect != OpcodeInfo::READ || !IsIdempotent(operand)) { return false; }
+        break;
+
+      // Taken, a branch also reads the byte after it and, when it crosses a
+      // page, the target's offset in the page it left.
+      case OpcodeInfo::REL: {
+        const uint16_t next = static_cast<uint16_t>(pc + 2);
+        const uint16_t to   = static_cast<uint16_t>(next + static_cast<int8_t>(operand));
+        if (!IsIdempotent(next)) { return false; }
+        if (((next ^ to) & 0xFF00) && !IsIdempotent((next & 0xFF00) | (to & 0xFF))) { return false; }
+        if (pc == branch) { return landsOnStarts(); }
+        if (to < target || to > branch) { return false; }
+        landings[landingCount++] = to;
+        break;
+      }
+
+      default:
+        return false;
+    }
+
+    pc += info.size;
+  }
+
+  return false;
+}
+
+//
+// Save States
+//
+
+template <typename Bus, typename Variant>
+size_t MOS6502T<Bus, Variant>::SaveState(uint8_t *buffer, size_t size) const {
+  if (size < STATE_SIZE) { return 0; }
+
+  const uint32_t lines = pending.load(std::memory_order_relaxed) & LINES;
+
+  uint8_t *p = buffer;
+  *p++ = 'M'; *p++ = '6'; *p++ = '5'; *p++ = STATE_VERSION;
+  *p++ = PC.l; *p++ = PC.h;
+  *p++ = 0; *p++ = 0; *p++ = 0; *p++ = 0;
+  *p++ = A; *p++ = X; *p++ = Y; *p++ = S; *p++ = Status();
+  *p++ = static_cast<uint8_t>(lines);
+  *p++ = running ? 1 : 0;
+  for (int shift = 0; shift < 64; shift += 8) { *p++ = static_cast<uint8_t>(cycles >> shift); }
+  std::fill(p, buffer + STATE_SIZE, 0);
+
+  return STATE_SIZE;
+}
+
+template <typename Bus, typename Variant>
+size_t MOS6502T<Bus, Variant>::LoadState(const uint8_t *buffer, size_t size) {
+  if (size < STATE_SIZE) { return 0; }
+  if (buffer[0] != 'M' || buffer[1] != '6' || buffer[2] != '5' || buffer[3] != STATE_VERSION) { return 0; }
+
+  const uint8_t *p = buffer + 4;
+  PC.l = *p++; PC.h = *p++;
+  p += 4;
+  A = *p++; X = *p++; Y = *p++; S = *p++; SetStatus(*p++);
+
+  // Keep any halt request and the debugger flags.
+  const uint32_t lines = *p++ & LINES;
+  pending.store((pending.load(std::memory_order_relaxed) & ~LINES) | lines, std::memory_order_relaxed);
+
+  running     = (*p++ != 0);
+  cycles = 0;
+  for (int shift = 0; shift < 64; shift += 8) { cycles |= static_cast<uint64_t>(*p++) << shift; }
+
+  // The host is about to restore its memory without going through Write().
+  InvalidateCode(0x0000, 0x10000);
+  ++idleEpoch;
+  ++stateEpoch;
+
+  return STATE_SIZE;
+}
+
+//
+// Addressing Modes
+//
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::Absolute_Modify(WORD operand) {
+  WORD AB = operand;
+  BYTE input = Read(AB.w);
+  Write(AB.w, input);
+  BYTE output = 0;
+  (this->*operation)(input, output);
+  Write(AB.w, output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::Absolute_Modify(WORD operand, BYTE index) {
+  WORD AB = operand;
+  AB = IdleOnPageAlways(AB, index);
+  BYTE input  = Read(AB.w);
+  Write(AB.w, input);
+  BYTE output = 0;
+  (this->*operation)(input, output);
+  Write(AB.w, output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::Absolute_Read(WORD operand, BYTE &output) {
+  WORD AB = operand;
+  (this->*operation)(Read(AB.w), output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::Absolute_Read(WORD operand, BYTE &output, BYTE index) {
+  WORD AB = operand;
+  AB = IdleOnPageCrossed(AB, index);
+  (this->*operation)(Read(AB.w), output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::Absolute_Write(WORD operand, BYTE &input) {
+  WORD AB = operand;
+  Write(AB.w, input);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::Absolute_Write(WORD operand, BYTE &input, BYTE index) {
+  WORD AB = operand;
+  AB = IdleOnPageAlways(AB, index);
+  Write(AB.w, input);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::Immediate_Read(WORD operand, BYTE &output) {
+  (this->*operation)(operand.l, output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::IndexedIndirect_Read(WORD operand, BYTE &output, BYTE index) {
+  WORD AB = {};
+  WORD TB = operand;
+  Read(TB.w);
+  TB.l += index;
+  AB.l  = Read(TB.w);
+  TB.l += 1;
+  AB.h  = Read(TB.w);
+  (this->*operation)(Read(AB.w), output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::IndexedIndirect_Write(WORD operand, BYTE &input, BYTE index) {
+  WORD AB = {};
+  WORD TB = operand;
+  Read(TB.w);
+  TB.l += index;
+  AB.l  = Read(TB.w);
+  TB.l += 1;
+  AB.h  = Read(TB.w);
+  Write(AB.w, input);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::IndirectIndexed_Read(WORD operand, BYTE &output, BYTE index) {
+  WORD AB = {};
+  WORD TB = operand;
+  AB.l  = Read(TB.w);
+  TB.l += 1;
+  AB.h  = Read(TB.w);
+  AB = IdleOnPageCrossed(AB, index);
+  (this->*operation)(Read(AB.w), output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::IndirectIndexed_Write(WORD operand, BYTE &input, BYTE index) {
+  WORD AB = {};
+  WORD TB = operand;
+  AB.l  = Read(TB.w);
+  TB.l += 1;
+  AB.h  = Read(TB.w);
+  AB = IdleOnPageAlways(AB, index);
+  Write(AB.w, input);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::ZeroPage_Modify(WORD operand) {
+  WORD AB = operand;
+  BYTE input  = Read(AB.w);
+  Write(AB.w, input);
+  BYTE output = 0;
+  (this->*operation)(input, output);
+  Write(AB.w, output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::ZeroPage_Modify(WORD operand, BYTE index) {
+  WORD AB = operand;
+  Read(AB.w);
+  AB.l += index;
+  BYTE input  = Read(AB.w);
+  Write(AB.w, input);
+  BYTE output = 0;
+  (this->*operation)(input, output);
+  Write(AB.w, output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::ZeroPage_Read(WORD operand, BYTE &output) {
+  WORD AB = operand;
+  (this->*operation)(Read(AB.w), output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::ZeroPage_Read(WORD operand, BYTE &output, BYTE index) {
+  WORD AB = operand;
+  Read(AB.w);
+  AB.l += index;
+  (this->*operation)(Read(AB.w), output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ZeroPage_Write(WORD operand, BYTE &input) {
+  WORD AB = operand;
+  Write(AB.w, input);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ZeroPage_Write(WORD operand, BYTE &input, BYTE index) {
+  WORD AB = operand;
+  Read(AB.w);
+  AB.l += index;
+  Write(AB.w, input);
+}
+
+//
+// Operations
+//
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ADC(BYTE input, BYTE &output) {
+  const AluResult result = AdcResult(A, input, flagC, cpu().DecimalEnabled() && P.D);
+  flagC  = result.carry;
+  flagV  = result.overflow;
+  output = Flags(result.value);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::AND(BYTE input, BYTE &output) {
+  output = Flags(A & input);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ASL(BYTE input, BYTE &output) {
+  const AluResult result = AslResult(input);
+  flagC  = result.carry;
+  output = Flags(result.value);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::BIT(BYTE input, [[maybe_unused]] BYTE &output) {
+  flagN = input;
+  flagV = (input & 0x40) ? 1 : 0;
+  flagZ = A & input;
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::CMP(BYTE input, BYTE &output) {
+  const AluResult result = CmpResult(output, input);
+  flagC = result.carry;
+  Flags(result.value);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::DEC(BYTE input, BYTE &output) {
+  output = Flags(input - 1);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::EOR(BYTE input, BYTE &output) {
+  output = Flags(A ^ input);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::INC(BYTE input, BYTE &output) {
+  output = Flags(input + 1);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::LDx(BYTE input, BYTE &output) {
+  output = Flags(input);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::LSR(BYTE input, BYTE &output) {
+  const AluResult result = LsrResult(input);
+  flagC  = result.carry;
+  output = Flags(result.value);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ORA(BYTE input, BYTE &output) {
+  output = Flags(A | input);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ROL(BYTE input, BYTE &output) {
+  const AluResult result = RolResult(input, flagC);
+  flagC  = result.carry;
+  output = Flags(result.value);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ROR(BYTE input, BYTE &output) {
+  const AluResult result = RorResult(input, flagC);
+  flagC  = result.carry;
+  output = Flags(result.value);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::SBC(BYTE input, BYTE &output) {
+  const AluResult result = SbcResult(A, input, flagC, cpu().DecimalEnabled() && P.D);
+  flagC  = result.carry;
+  flagV  = result.overflow;
+  output = Flags(result.value);
+}
+
+//
+// Control Flow
+//
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::BRK() {
+  Fetch();
+  Push(PC.h);
+  Push(PC.l);
+  Push(Status() | P_BT_MASK);
+  PC.l = Read(0xFFFE);
+  PC.h = Read(0xFFFF);
+  P.I  = 1;
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::JMP_Absolute(WORD operand) {
+  WORD AB = operand;
+  const uint16_t jump = static_cast<uint16_t>(PC.w - 3);
+  PC   = AB;
+  if (cpu().idleSkipEnabled && AB.w <= jump) { LoopBack(jump, AB.w); }
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::JMP_Indirect(WORD operand) {
+  WORD AB = operand;
+  PC.l  = Read(AB.w);
+  AB.l += 1;
+  PC.h  = Read(AB.w);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::JSR(WORD operand) {
+  WORD AB = operand;
+  IdleStack();
+  Push(PC.h);
+  Push(PC.l);
+  AB.h = Fetch();
+  PC   = AB;
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::PLP() {
+  Idle();
+  IdleStack();
+  SetStatus((Pull() & ~0x10) | 0x20);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::RTI() {
+  PLP();
+  PC.l = Pull();
+  PC.h = Pull();
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::RTS() {
+  Idle();
+  IdleStack();
+  PC.l = Pull();
+  PC.h = Pull();
+  Fetch();
+}
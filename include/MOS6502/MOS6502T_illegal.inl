@@ -0,0 +1,110 @@
+//
+// MOS6502T_illegal.inl
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+
+//
+// Illegal Addressing Modes
+//
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::IndexedIndirect_Modify(WORD operand, BYTE index) {
+  WORD AB = {};
+  WORD TB = operand;
+  Read(TB.w);
+  TB.l += index;
+  AB.l  = Read(TB.w);
+  TB.l += 1;
+  AB.h  = Read(TB.w);
+  BYTE input = Read(AB.w);
+  Write(AB.w, input);
+  BYTE output = 0;
+  (this->*operation)(input, output);
+  Write(AB.w, output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+template <typename MOS6502Core<Bus, Variant, LOCAL>::OPERATION operation>
+void MOS6502Core<Bus, Variant, LOCAL>::IndirectIndexed_Modify(WORD operand, BYTE index) {
+  WORD AB = {};
+  WORD TB = operand;
+  AB.l  = Read(TB.w);
+  TB.l += 1;
+  AB.h  = Read(TB.w);
+  AB    = IdleOnPageAlways(AB, index);
+  BYTE input = Read(AB.w);
+  Write(AB.w, input);
+  BYTE output = 0;
+  (this->*operation)(input, output);
+  Write(AB.w, output);
+}
+
+// SHY, SHX and TAS: store input & (high byte + 1) at abs,index.
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::AbsoluteHigh_Write(WORD operand, BYTE input, BYTE index) {
+  WORD AB = operand;
+  BYTE v = input & (AB.h + 1);
+  AB = IdleOnPageAlways(AB, index);
+  Write(AB.w, v);
+}
+
+//
+// Illegal Operations
+//
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::DCP(BYTE input, BYTE &output) { DEC(input, output); CMP(output, A); }
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ISC(BYTE input, BYTE &output) { INC(input, output); SBC(output, A); }
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::RLA(BYTE input, BYTE &output) { ROL(input, output); AND(output, A); }
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::RRA(BYTE input, BYTE &output) { ROR(input, output); ADC(output, A); }
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::SLO(BYTE input, BYTE &output) { ASL(input, output); ORA(output, A); }
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::SRE(BYTE input, BYTE &output) { LSR(input, output); EOR(output, A); }
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ALR(BYTE input, BYTE &output) {
+  AND(input, output);
+  LSR(output, output);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ANC(BYTE input, BYTE &output) {
+  AND(input, output);
+  flagC = flagN >> 7;
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::ARR(BYTE input, BYTE &output) {
+  AND(input, output);
+  output = (output >> 1) | (flagC << 7);
+  Flags(output);
+  flagC = (output & 0x40) ? 1 : 0;
+  flagV = ((output ^ (output << 1)) & 0x40) ? 1 : 0;
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::AXS(BYTE input, BYTE &output) {
+  uint16_t temp = (A & X) - input;
+  flagC = (temp < 0x100) ? 1 : 0;
+  output = Flags(temp & 0xFF);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::LAS(BYTE input, [[maybe_unused]] BYTE &output) {
+  A = X = S = Flags(input & S);
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::LAX(BYTE input, [[maybe_unused]] BYTE &output) {
+  A = Flags(input); X = A;
+}
+
+template <typename Bus, typename Variant, bool LOCAL>
+void MOS6502Core<Bus, Variant, LOCAL>::NOP([[maybe_unused]] BYTE input, [[maybe_unused]] BYTE &output) { }
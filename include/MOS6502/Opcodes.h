@@ -0,0 +1,73 @@
+//
+// Opcodes.h
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+#include <array>
+#include <cstdint>
+
+//
+// Static description of every opcode, generated from OpcodeTable.inc, for
+// disassemblers, tracers, profilers and the core's own code cache.
+//
+
+struct OpcodeInfo {
+
+  enum MODE : uint8_t {
+    IMP,  // implied
+    ACC,  // accumulator
+    IMM,  // #imm
+    ZPG,  // zp
+    ZPX,  // zp,X
+    ZPY,  // zp,Y
+    ABS,  // abs
+    ABX,  // abs,X
+    ABY,  // abs,Y
+    IND,  // (abs)
+    IZX,  // (zp,X)
+    IZY,  // (zp),Y
+    REL,  // branch offset
+  };
+
+  enum KIND : uint8_t { OFFICIAL, ILLEGAL, UNKNOWN };
+
+  // What an opcode does besides updating registers and flags, fetching its
+  // own bytes and the dummy reads of its addressing mode.
+  enum EFFECT : uint8_t {
+    NONE,    // nothing else; immediate operands are fetched, not read
+    READ,    // reads its memory operand
+    WRITE,   // writes its memory operand
+    MODIFY,  // reads its memory operand and writes it back
+    STACK,   // pushes or pulls
+    FLOW,    // branches, jumps, calls, returns and BRK
+  };
+
+  const char *mnemonic = "???";
+  MODE        mode     = IMP;
+  uint8_t     size     = 1;  // bytes, including the opcode
+  uint8_t     cycles   = 0;  // base cycles, before page-cross and branch penalties
+  KIND        kind     = UNKNOWN;
+  EFFECT      effect   = NONE;
+
+  static constexpr uint8_t Size(MODE mode) {
+    switch (mode) {
+      case IMP: case ACC:                     return 1;
+      case ABS: case ABX: case ABY: case IND: return 3;
+      default:                                return 2;
+    }
+  }
+
+};
+
+inline constexpr std::array<OpcodeInfo, 0x100> OPCODE_INFO = [] {
+  std::array<OpcodeInfo, 0x100> table = {};
+
+#define OPCODE(opcode, mnemonic, mode, base, kind, effect, ...) \
+  table[opcode] = { #mnemonic, OpcodeInfo::mode, OpcodeInfo::Size(OpcodeInfo::mode), base, OpcodeInfo::kind, \
+                    OpcodeInfo::effect };
+#include "MOS6502/OpcodeTable.inc"
+#undef OPCODE
+
+  return table;
+}();
@@ -0,0 +1,134 @@
+//
+// Profiler.h
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+#include "MOS6502/Opcodes.h"
+
+//
+// Execution counters, a base of MOS6502T. A variant with PROFILE set (see
+// Profiled in Variants.h) gets the full profiler; every other variant gets
+// the empty specialisation, which takes no space and whose hooks are never
+// compiled, so the core is unchanged.
+//
+
+template <bool ENABLED>
+class Profiler {};
+
+template <>
+class Profiler<true>
+{
+
+public:
+
+  struct OpcodeCounters {
+    uint64_t executed    = 0;
+    uint64_t cycles      = 0;  // including the opcode fetch and any penalties
+    uint64_t taken       = 0;  // branches only
+    uint64_t notTaken    = 0;  // branches only
+    uint64_t pageCrossed = 0;  // indexed reads and taken branches that paid the extra cycle
+  };
+
+  Profiler() : pcExecuted(0x10000), pcCycles(0x10000) {}
+
+  const OpcodeCounters &OpcodeProfile(uint8_t opcode) const { return opcodes[opcode]; }
+
+  // Counters for the instruction starting at `pc`.
+  uint64_t ExecutedAt(uint16_t pc) const { return pcExecuted[pc]; }
+  uint64_t CyclesAt(uint16_t pc) const { return pcCycles[pc]; }
+
+  void ResetProfile() {
+    opcodes = {};
+    std::fill(pcExecuted.begin(), pcExecuted.end(), 0);
+    std::fill(pcCycles.begin(), pcCycles.end(), 0);
+  }
+
+  // Writes the `rows` most expensive opcodes, addresses and branches, by
+  // cycles spent, to `file`.
+  void ProfileReport(FILE *file, size_t rows = 20) const {
+    uint64_t total = 0;
+    for (const OpcodeCounters &counters : opcodes) { total += counters.cycles; }
+    const double percent = total ? 100.0 / static_cast<double>(total) : 0.0;
+
+    std::fprintf(file, "%" PRIu64 " cycles profiled\n", total);
+
+    std::vector<uint32_t> order(0x100);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+      return opcodes[a].cycles > opcodes[b].cycles;
+    });
+
+    std::fprintf(file, "\nopcode       executed         cycles      %%    pagecross\n");
+    for (size_t row = 0; row < std::min<size_t>(rows, order.size()); row++) {
+      const OpcodeCounters &counters = opcodes[order[row]];
+      if (!counters.executed) { break; }
+      std::fprintf(file, "%02X %-4s %14" PRIu64 " %14" PRIu64 " %6.2f %12" PRIu64 "\n",
+        order[row], OPCODE_INFO[order[row]].mnemonic, counters.executed, counters.cycles,
+        static_cast<double>(counters.cycles) * percent, counters.pageCrossed);
+    }
+
+    order.resize(0x10000);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+      return pcCycles[a] > pcCycles[b];
+    });
+
+    std::fprintf(file, "\npc           executed         cycles      %%\n");
+    for (size_t row = 0; row < std::min<size_t>(rows, order.size()); row++) {
+      if (!pcExecuted[order[row]]) { break; }
+      std::fprintf(file, "%04X   %14" PRIu64 " %14" PRIu64 " %6.2f\n",
+        order[row], pcExecuted[order[row]], pcCycles[order[row]],
+        static_cast<double>(pcCycles[order[row]]) * percent);
+    }
+
+    std::fprintf(file, "\nbranch          taken      not taken    pagecross\n");
+    for (uint32_t opcode = 0x10; opcode < 0x100; opcode += 0x20) {
+      const OpcodeCounters &counters = opcodes[opcode];
+      std::fprintf(file, "%02X %-4s %14" PRIu64 " %14" PRIu64 " %12" PRIu64 "\n",
+        opcode, OPCODE_INFO[opcode].mnemonic, counters.taken, counters.notTaken, counters.pageCrossed);
+    }
+  }
+
+protected:
+
+  // Called by the core around each instruction, and from Branch() and the
+  // page-cross penalty within one. Interrupt entry is not attributed.
+  void ProfileBegin(uint16_t pc, uint8_t opcode, uint64_t cycle) {
+    currentOpcode = opcode;
+    currentPC = pc;
+    start = cycle;
+  }
+
+  void ProfileEnd(uint64_t cycle) {
+    opcodes[currentOpcode].executed++;
+    opcodes[currentOpcode].cycles += cycle - start;
+    pcExecuted[currentPC]++;
+    pcCycles[currentPC] += cycle - start;
+  }
+
+  void ProfileBranch(bool taken) {
+    OpcodeCounters &counters = opcodes[currentOpcode];
+    (taken ? counters.taken : counters.notTaken)++;
+  }
+
+  void ProfilePageCross() { opcodes[currentOpcode].pageCrossed++; }
+
+private:
+
+  std::array<OpcodeCounters, 0x100> opcodes = {};
+  std::vector<uint64_t> pcExecuted;
+  std::vector<uint64_t> pcCycles;
+
+  uint8_t  currentOpcode = 0;
+  uint16_t currentPC = 0;
+  uint64_t start = 0;
+
+};
@@ -0,0 +1,234 @@
+//
+// Rewind.h
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "MOS6502/Journal.h"
+#include "MOS6502/MOS6502T.h"
+
+//
+// Steps a machine backwards in time.
+//
+// While the machine runs through Run() or Step() here, a full SaveState()
+// keyframe is taken every `interval` cycles, and in between the core journals
+// each store to mapped memory as one (address, old value) append. Going back
+// restores the newest keyframe at or before the target: the journal is played
+// backwards to put mapped memory back as it was, then LoadState() restores
+// the CPU and whatever the host saves with it. The machine then steps forward
+// again to the exact instruction boundary.
+//
+// Memory is fixed at construction: `keyframes` states of `stateSize` bytes,
+// plus a journal of `journal` entries. A keyframe is dropped once the journal
+// no longer holds every store since it, or when a newer one needs its slot.
+//
+// Replaying forward must reproduce what happened the first time. Everything
+// that can change execution but lives outside mapped memory has to be in the
+// machine's SaveState(): device registers, bank selection, and any memory
+// behind Load()/Store(). Scheduled events are not saved, so hosts that use
+// Schedule() must re-arm them from their own LoadState(). The journal writes
+// back through the current page mappings, so hosts must not remap writable
+// pages while rewinding is enabled.
+//
+
+template <typename Machine>
+class Rewind
+{
+
+public:
+
+  struct Config {
+    uint64_t interval  = 100000;               // cycles between keyframes, at least 1
+    size_t   keyframes = 64;                   // at least 1
+    size_t   journal   = 1 << 20;              // entries, at least 2, rounded up to a power of two
+    size_t   stateSize = Machine::STATE_SIZE;
+  };
+
+  explicit Rewind(Machine &machine) : Rewind(machine, Config()) {}
+
+  Rewind(Machine &machine, const Config &config)
+    : machine(machine),
+      config(config),
+      journal(std::max<size_t>(config.journal, 2)),
+      keyframes(std::max<size_t>(config.keyframes, 1)),
+      states(keyframes.size() * config.stateSize) {
+    // Run() slices at most interval cycles, and half the journal, at a time;
+    // either being zero would leave it no room to make progress.
+    this->config.interval = std::max<uint64_t>(config.interval, 1);
+    machine.SetJournal(&journal);
+    TakeKeyframe();
+  }
+
+  ~Rewind() { machine.SetJournal(nullptr); }
+
+  Rewind(const Rewind &) = delete;
+  Rewind &operator=(const Rewind &) = delete;
+
+  // As Machine::Run(budget), taking keyframes along the way.
+  uint64_t Run(uint64_t budget) {
+    const uint64_t start = machine.Cycles();
+    const uint64_t end   = (budget > UINT64_MAX - start) ? UINT64_MAX : start + budget;
+
+    while (machine.Cycles() < end) {
+      if (!count || Due()) { TakeKeyframe(); }
+      if (!count) {
+        // stateSize is too small for this machine's SaveState().
+        machine.Run(end - machine.Cycles());
+        break;
+      }
+
+      // A store takes at least a cycle, so running no more cycles than the
+      // journal has room for keeps the newest keyframe restorable.
+      const Keyframe &newest = At(count - 1);
+      const uint64_t used  = journal.Count() - newest.journal;
+      const uint64_t room  = (used < journal.Capacity() / 2) ? journal.Capacity() / 2 - used : 0;
+      const uint64_t slice = std::min({ end - machine.Cycles(), newest.cycle + config.interval - machine.Cycles(), room });
+
+      const uint64_t target = machine.Cycles() + slice;
+      machine.Run(slice);
+      if (machine.Cycles() < target) { break; }  // halted
+    }
+
+    return machine.Cycles() - start;
+  }
+
+  // As Machine::Step(), taking a keyframe when one is due.
+  uint32_t Step() {
+    const uint32_t cycles = machine.Step();
+    if (!count || Due()) { TakeKeyframe(); }
+    return cycles;
+  }
+
+  // Returns to the first instruction boundary at or after `cycle`, which must
+  // not be in the future. Returns false, changing nothing, if no keyframe
+  // that old is still held.
+  bool RewindTo(uint64_t cycle) {
+    if (cycle > machine.Cycles()) { return false; }
+
+    Prune();
+    for (size_t index = count; index-- > 0; ) {
+      if (At(index).cycle <= cycle) {
+        Restore(index);
+        Replay(cycle);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  // Undoes the last `instructions` instructions (an interrupt entry counts
+  // with the instruction after it). Returns false, with the machine and its
+  // history back where they were, if the history does not reach back that far.
+  bool StepBack(uint64_t instructions = 1) {
+    const uint64_t now = machine.Cycles();
+    if (!instructions) { return true; }
+
+    Prune();
+    const size_t   held   = count;
+    const uint64_t stores = journal.Count();
+
+    std::vector<uint64_t> boundaries;
+    for (size_t index = count; index-- > 0; ) {
+      if (At(index).cycle >= now) { continue; }
+
+      // Replay once to find where each instruction started...
+      Restore(index);
+      boundaries.clear();
+      while (machine.Cycles() < now) {
+        boundaries.push_back(machine.Cycles());
+        if (!machine.Step()) { break; }
+      }
+
+      // ...and again to stop at the right one.
+      if (boundaries.size() >= instructions) {
+        Restore(index);
+        Replay(boundaries[boundaries.size() - instructions]);
+        return true;
+      }
+    }
+
+    // Each attempt replayed back up to `now`, journaling the same stores
+    // again, and the newer keyframes' states are untouched in their slots,
+    // so they all still line up and can be kept.
+    if (machine.Cycles() == now && journal.Count() == stores) { count = held; }
+    return false;
+  }
+
+  // The earliest cycle RewindTo() can currently reach.
+  uint64_t Oldest() {
+    Prune();
+    return count ? At(0).cycle : machine.Cycles();
+  }
+
+private:
+
+  struct Keyframe {
+    uint64_t cycle   = 0;
+    uint64_t journal = 0;  // journal.Count() when taken
+  };
+
+  Machine     &machine;
+  Config       config;
+  StoreJournal journal;
+
+  // A ring of keyframes, oldest at `first`, each with its slot in `states`.
+  std::vector<Keyframe> keyframes;
+  std::vector<uint8_t>  states;
+  size_t first = 0;
+  size_t count = 0;
+
+  size_t Slot(size_t index) const { return (first + index) % keyframes.size(); }
+  const Keyframe &At(size_t index) const { return keyframes[Slot(index)]; }
+
+  bool Due() const {
+    const Keyframe &newest = At(count - 1);
+    return machine.Cycles() >= newest.cycle + config.interval
+        || journal.Count() - newest.journal >= journal.Capacity() / 2;
+  }
+
+  void TakeKeyframe() {
+    if (count == keyframes.size()) {
+      first = (first + 1) % keyframes.size();
+      count--;
+    }
+
+    const size_t slot = Slot(count);
+    if (!machine.SaveState(&states[slot * config.stateSize], config.stateSize)) { return; }
+    keyframes[slot] = { machine.Cycles(), journal.Count() };
+    count++;
+  }
+
+  // Drops the oldest keyframes whose stores have been overwritten.
+  void Prune() {
+    while (count && journal.Count() - At(0).journal > journal.Capacity()) {
+      first = (first + 1) % keyframes.size();
+      count--;
+    }
+  }
+
+  // Puts the machine back at keyframe `index`; the newer ones are discarded.
+  void Restore(size_t index) {
+    const Keyframe keyframe = At(index);
+
+    for (uint64_t entry = journal.Count(); entry > keyframe.journal; ) {
+      const StoreJournal::Entry &store = journal.At(--entry);
+      machine.Restore(store.address, store.value);
+    }
+    journal.Truncate(keyframe.journal);
+
+    machine.LoadState(&states[Slot(index) * config.stateSize], config.stateSize);
+    count = index + 1;
+  }
+
+  void Replay(uint64_t cycle) {
+    while (machine.Cycles() < cycle) {
+      if (!machine.Step()) { break; }
+    }
+  }
+
+};
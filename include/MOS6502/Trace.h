@@ -0,0 +1,181 @@
+//
+// Trace.h
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "MOS6502/Opcodes.h"
+
+//
+// Instruction trace ring, filled by MOS6502T::SetTrace(). Each record is the
+// state before an instruction executes. The core is the only writer and
+// never allocates or formats; readers on any thread (or a crash handler on
+// the CPU's own thread) take a snapshot of the most recent records and render
+// them with FormatNestest() at their leisure.
+//
+// Slots are held as relaxed atomic words, so a reader may copy them while the
+// CPU overwrites them, seqlock style: the writer announces the record it is
+// about to write in `writing` before touching its slot and publishes it in
+// `head` after, and a reader that finds `writing` has since moved onto a slot
+// it copied drops that record.
+//
+
+struct TraceRecord {
+  uint64_t cycle;
+  uint16_t pc;
+  uint8_t  opcode;
+  uint8_t  operand[2];  // the bytes after the opcode, as many as it uses
+  uint8_t  A, X, Y, P, S;
+};
+
+static_assert(sizeof(TraceRecord) % sizeof(uint64_t) == 0, "TraceRecord must be a whole number of words");
+
+class TraceBuffer
+{
+
+public:
+
+  // Capacity is rounded up to a power of two.
+  explicit TraceBuffer(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) { size <<= 1; }
+    slots = std::vector<std::atomic<uint64_t>>(size * WORDS);
+    mask  = size - 1;
+  }
+
+  size_t Capacity() const { return mask + 1; }
+
+  // Records written since construction or Clear(), including overwritten ones.
+  uint64_t Count() const { return head.load(std::memory_order_acquire); }
+
+  // Only while the CPU is not writing to it.
+  void Clear() {
+    writing.store(0, std::memory_order_relaxed);
+    head.store(0, std::memory_order_release);
+  }
+
+  // Single producer: only the CPU that owns this buffer calls Record().
+  inline void Record(const TraceRecord &record) {
+    const uint64_t index = head.load(std::memory_order_relaxed);
+    writing.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint64_t words[WORDS];
+    std::memcpy(words, &record, sizeof(record));
+    std::atomic<uint64_t> *slot = &slots[(index & mask) * WORDS];
+    for (size_t word = 0; word < WORDS; word++) { slot[word].store(words[word], std::memory_order_relaxed); }
+
+    head.store(index + 1, std::memory_order_release);
+  }
+
+  // Copies up to `max` of the most recent records to `out`, oldest first, and
+  // returns how many. While the CPU runs, records it overwrote during the
+  // copy are dropped, so a snapshot may hold fewer than asked for; every
+  // record it does return is whole.
+  size_t Snapshot(TraceRecord *out, size_t max) const {
+    const uint64_t end   = Count();
+    const uint64_t count = std::min<uint64_t>({ end, Capacity(), max });
+    const uint64_t begin = end - count;
+
+    for (uint64_t index = begin; index < end; index++) {
+      const std::atomic<uint64_t> *slot = &slots[(index & mask) * WORDS];
+      uint64_t words[WORDS];
+      for (size_t word = 0; word < WORDS; word++) { words[word] = slot[word].load(std::memory_order_relaxed); }
+      std::memcpy(&out[index - begin], words, sizeof(TraceRecord));
+    }
+
+    // Any slot the CPU started rewriting since `end` belongs to a record
+    // older than `writing - Capacity()`.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t written = writing.load(std::memory_order_relaxed);
+    const uint64_t oldest  = (written > Capacity()) ? written - Capacity() : 0;
+    const uint64_t torn    = std::min(count, (oldest > begin) ? oldest - begin : 0);
+    std::memmove(out, out + torn, static_cast<size_t>(count - torn) * sizeof(TraceRecord));
+    return static_cast<size_t>(count - torn);
+  }
+
+private:
+
+  static constexpr size_t WORDS = sizeof(TraceRecord) / sizeof(uint64_t);
+
+  std::vector<std::atomic<uint64_t>> slots;
+  size_t mask = 0;
+  std::atomic<uint64_t> head = 0;
+  std::atomic<uint64_t> writing = 0;  // head + 1 while a record is being written
+
+};
+
+//
+// nestest.log Format
+//
+
+// Renders `record` as one nestest.log line, without the newline, e.g.
+//
+//   C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD CYC:7
+//
+// The trace holds no memory contents, so the "= xx" operand values and the
+// PPU column are omitted. Returns the length snprintf would have written.
+inline int FormatNestest(const TraceRecord &record, char *buffer, size_t size) {
+  const OpcodeInfo &info = OPCODE_INFO[record.opcode];
+  const uint8_t  low  = record.operand[0];
+  const uint16_t word = static_cast<uint16_t>(low | (record.operand[1] << 8));
+
+  char bytes[12];
+  switch (info.size) {
+    case 1:  std::snprintf(bytes, sizeof(bytes), "%02X", record.opcode); break;
+    case 2:  std::snprintf(bytes, sizeof(bytes), "%02X %02X", record.opcode, low); break;
+    default: std::snprintf(bytes, sizeof(bytes), "%02X %02X %02X", record.opcode, low, record.operand[1]); break;
+  }
+
+  char operand[16] = "";
+  switch (info.mode) {
+    case OpcodeInfo::IMP: break;
+    case OpcodeInfo::ACC: std::strcpy(operand, "A"); break;
+    case OpcodeInfo::IMM: std::snprintf(operand, sizeof(operand), "#$%02X", low); break;
+    case OpcodeInfo::ZPG: std::snprintf(operand, sizeof(operand), "$%02X", low); break;
+    case OpcodeInfo::ZPX: std::snprintf(operand, sizeof(operand), "$%02X,X", low); break;
+    case OpcodeInfo::ZPY: std::snprintf(operand, sizeof(operand), "$%02X,Y", low); break;
+    case OpcodeInfo::ABS: std::snprintf(operand, sizeof(operand), "$%04X", word); break;
+    case OpcodeInfo::ABX: std::snprintf(operand, sizeof(operand), "$%04X,X", word); break;
+    case OpcodeInfo::ABY: std::snprintf(operand, sizeof(operand), "$%04X,Y", word); break;
+    case OpcodeInfo::IND: std::snprintf(operand, sizeof(operand), "($%04X)", word); break;
+    case OpcodeInfo::IZX: std::snprintf(operand, sizeof(operand), "($%02X,X)", low); break;
+    case OpcodeInfo::IZY: std::snprintf(operand, sizeof(operand), "($%02X),Y", low); break;
+    case OpcodeInfo::REL:
+      std::snprintf(operand, sizeof(operand), "$%04X",
+        static_cast<uint16_t>(record.pc + 2 + static_cast<int8_t>(low)));
+      break;
+  }
+
+  // nestest marks undocumented opcodes with '*', calls ISC "ISB", and shows
+  // P as an interrupt would push it: U set, B clear.
+  const char *mnemonic = (std::strcmp(info.mnemonic, "ISC") == 0) ? "ISB" : info.mnemonic;
+
+  char text[24];
+  std::snprintf(text, sizeof(text), "%s%s%s", mnemonic, operand[0] ? " " : "", operand);
+
+  return std::snprintf(buffer, size,
+    "%04X  %-8s %c%-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%" PRIu64,
+    record.pc, bytes, info.kind == OpcodeInfo::OFFICIAL ? ' ' : '*', text,
+    record.A, record.X, record.Y, (record.P | 0x20) & ~0x10, record.S, record.cycle);
+}
+
+// Writes the last `count` records of `trace` to `file`, one line each.
+inline void DumpNestest(const TraceBuffer &trace, FILE *file, size_t count = SIZE_MAX) {
+  std::vector<TraceRecord> records(std::min<uint64_t>({ trace.Count(), trace.Capacity(), count }));
+  records.resize(trace.Snapshot(records.data(), records.size()));
+
+  char line[128];
+  for (const TraceRecord &record : records) {
+    FormatNestest(record, line, sizeof(line));
+    std::fprintf(file, "%s\n", line);
+  }
+}
@@ -0,0 +1,65 @@
+//
+// Variants.h
+// by Naomi Peori (naomi@peori.ca)
+//
+
+#pragma once
+
+//
+// CPU variants, passed as MOS6502T's second template parameter.
+//
+//   DECIMAL  ADC/SBC honour the D flag
+//   ILLEGAL  the implemented undocumented opcodes run; otherwise they reach
+//            OnUnknownOpcode like any other unknown opcode
+//   RUNTIME  ignore the two above and test enableBCD / enableIllegal on every
+//            instruction instead; DECIMAL and ILLEGAL are their initial values
+//   PROFILE  count executions and cycles per opcode and per PC (Profiler.h)
+//
+// A fixed variant lets the compiler drop the unused paths entirely.
+//
+
+// The original runtime-flag behaviour, and the default.
+struct RuntimeVariant {
+  static constexpr bool RUNTIME = true;
+  static constexpr bool DECIMAL = true;
+  static constexpr bool ILLEGAL = false;
+  static constexpr bool PROFILE = false;
+};
+
+// NMOS 6502 running documented opcodes only.
+struct Nmos6502 {
+  static constexpr bool RUNTIME = false;
+  static constexpr bool DECIMAL = true;
+  static constexpr bool ILLEGAL = false;
+  static constexpr bool PROFILE = false;
+};
+
+// NMOS 6502 including the stable undocumented opcodes.
+struct Nmos6502Illegal {
+  static constexpr bool RUNTIME = false;
+  static constexpr bool DECIMAL = true;
+  static constexpr bool ILLEGAL = true;
+  static constexpr bool PROFILE = false;
+};
+
+// NES 2A03: an NMOS core with decimal mode disconnected in silicon.
+struct Ricoh2A03 {
+  static constexpr bool RUNTIME = false;
+  static constexpr bool DECIMAL = false;
+  static constexpr bool ILLEGAL = true;
+  static constexpr bool PROFILE = false;
+};
+
+// NES 2A03 running documented opcodes only.
+struct Ricoh2A03Official {
+  static constexpr bool RUNTIME = false;
+  static constexpr bool DECIMAL = false;
+  static constexpr bool ILLEGAL = false;
+  static constexpr bool PROFILE = false;
+};
+
+// Any of the above with the profiler compiled in, e.g. Profiled<Ricoh2A03>.
+template <typename Base>
+struct Profiled : Base {
+  static constexpr bool PROFILE = true;
+};
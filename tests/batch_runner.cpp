@@ -0,0 +1,140 @@
+//
+// batch_runner.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common.h"
+#include "MOS6502/BatchRunner.h"
+
+//
+// BatchRunner must put each job's result at the job's index whichever
+// worker ran it, run a single worker's jobs in order, let idle workers steal
+// from a busy one, and report a job that throws without losing the rest.
+//
+
+using Runner = BatchRunner<Machine>;
+
+// INC $10 forever.
+static std::unique_ptr<Machine> Build() {
+  return std::make_unique<Machine>(std::initializer_list<uint8_t>{ 0xE6, 0x10, 0x4C, 0x00, 0x02 }, 0x0200);
+}
+
+static std::string Message(const std::exception_ptr &error) {
+  try {
+    std::rethrow_exception(error);
+  } catch (const std::exception &exception) {
+    return exception.what();
+  } catch (...) {
+    return "";
+  }
+}
+
+// Each job tags its machine with its index and reads the tag back, on a
+// budget of its own.
+static void Placement() {
+  static constexpr size_t JOBS = 64;
+  std::vector<uint8_t> tags(JOBS);
+  std::vector<Runner::Job> jobs(JOBS);
+  for (size_t index = 0; index < JOBS; index++) {
+    jobs[index].cycles = 1000 + index * 100;
+    jobs[index].setup  = [index](Machine &machine) {
+      machine.memory[0x20] = static_cast<uint8_t>(index);
+      machine.Reset();
+    };
+    jobs[index].finish = [&tags, index](Machine &machine) { tags[index] = machine.memory[0x20]; };
+  }
+
+  const std::vector<Runner::Result> results = Runner(Build, 4).Run(jobs);
+  bool placed = results.size() == JOBS;
+  for (size_t index = 0; placed && index < JOBS; index++) {
+    placed = tags[index] == index && results[index].cycles >= jobs[index].cycles
+          && results[index].cycles < jobs[index].cycles + 7 && !results[index].error;
+  }
+  Check(placed, "each result lands at its job's index");
+}
+
+// One worker runs its queue front to back.
+static void Ordering() {
+  std::vector<size_t> order;
+  std::vector<Runner::Job> jobs(16);
+  for (size_t index = 0; index < jobs.size(); index++) {
+    jobs[index].cycles = 100;
+    jobs[index].setup  = [&order, index](Machine &machine) { order.push_back(index); machine.Reset(); };
+  }
+
+  Runner(Build, 1).Run(jobs);
+  bool ordered = order.size() == jobs.size();
+  for (size_t index = 0; ordered && index < order.size(); index++) { ordered = order[index] == index; }
+  Check(ordered, "a single worker runs jobs in order");
+}
+
+// Job 0 holds the first worker until every other job is done, so the
+// second worker must steal what was dealt to the first.
+static void Stealing() {
+  static constexpr size_t JOBS = 9;
+  std::atomic<size_t> done = 0;
+  std::vector<std::thread::id> ran(JOBS);
+  std::vector<Runner::Job> jobs(JOBS);
+  for (size_t index = 0; index < JOBS; index++) {
+    jobs[index].cycles = 100;
+    jobs[index].setup  = [&done, index](Machine &machine) {
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+      while (index == 0 && done < JOBS - 1 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+      }
+      machine.Reset();
+    };
+    jobs[index].finish = [&done, &ran, index](Machine &) {
+      ran[index] = std::this_thread::get_id();
+      done++;
+    };
+  }
+
+  Runner(Build, 2).Run(jobs);
+  bool stolen = done == JOBS;
+  for (size_t index = 1; stolen && index < JOBS; index++) { stolen = ran[index] != ran[0]; }
+  Check(stolen, "an idle worker steals from a busy one");
+}
+
+// Throws from setup, from an event during Run() and from finish are each
+// reported on their own job; the worker replaces its machine and goes on.
+static void Exceptions() {
+  size_t built = 0;
+  const auto factory = [&built] { built++; return Build(); };
+
+  std::vector<Runner::Job> jobs(7);
+  for (Runner::Job &job : jobs) {
+    job.cycles = 1000;
+    job.setup  = [](Machine &machine) { machine.Reset(); };
+  }
+  jobs[1].setup = [](Machine &) { throw std::runtime_error("setup"); };
+  jobs[3].setup = [](Machine &machine) {
+    machine.Reset();
+    machine.Schedule(machine.Cycles() + 500, [] { throw std::runtime_error("run"); });
+  };
+  jobs[5].finish = [](Machine &) { throw std::runtime_error("finish"); };
+
+  const std::vector<Runner::Result> results = Runner(factory, 1).Run(jobs);
+  Check(Message(results[1].error) == "setup" && Message(results[3].error) == "run"
+        && Message(results[5].error) == "finish", "a throwing job reports what it threw");
+  Check(!results[0].error && !results[2].error && !results[4].error && !results[6].error,
+        "the jobs around a throwing one succeed");
+  Check(results[4].cycles >= 1000 && results[6].cycles >= 1000, "the jobs after a throwing one run in full");
+  Check(built == 4, "a worker rebuilds its machine after a job throws");
+}
+
+int main() {
+  Placement();
+  Ordering();
+  Stealing();
+  Exceptions();
+
+  return Report("batch_runner");
+}
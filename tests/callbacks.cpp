@@ -0,0 +1,109 @@
+//
+// callbacks.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <memory>
+#include "common.h"
+
+//
+// A mapped Run() works on a copy of the registers, which must be reloaded
+// whenever a bus callback or event changes the CPU under it. Each run here
+// has callbacks call SetRegisters(), LoadState() and Step() mid-run, and
+// must end exactly as the same run on the in-place core, with no pages
+// mapped.
+//
+
+// Page $40 is a device whose reads bump X through SetRegisters() and whose
+// writes restore a saved state, the first few times.
+class Host : public MOS6502T<Host, Nmos6502> {
+
+public:
+
+  explicit Host(bool mapped) {
+    std::copy(CODE.begin(), CODE.end(), memory + 0x0200);
+    memory[0xFFFC] = 0x00;
+    memory[0xFFFD] = 0x02;
+    if (mapped) {
+      MapPages(0x0000, 0x4000, memory, memory);
+      MapPages(0x4100, 0xBF00, memory + 0x4100, memory + 0x4100);
+    }
+  }
+
+  uint8_t Load(uint16_t address, bool peek = false) {
+    if (address == 0x4000 && !peek) {
+      Registers registers = GetRegisters();
+      registers.X += 0x11;
+      SetRegisters(registers);
+    }
+    return memory[address];
+  }
+
+  void Store(uint16_t address, uint8_t value) {
+    if (address == 0x4001 && restores < 3) {
+      restores++;
+      LoadState(saved, sizeof(saved));
+      memory[0x12] = static_cast<uint8_t>(memory[0x12] + value);
+      return;
+    }
+    memory[address] = value;
+  }
+
+  uint8_t memory[0x10000] = {};
+  uint8_t saved[STATE_SIZE] = {};
+  int     restores = 0;
+
+private:
+
+  static constexpr std::initializer_list<uint8_t> CODE = {
+    0xA2, 0x00,        // $0200: LDX #$00
+    0xAD, 0x00, 0x40,  // $0202: LDA $4000, which adds $11 to X
+    0xE8,              // $0205: INX
+    0x86, 0x10,        // $0206: STX $10
+    0x65, 0x10,        // $0208: ADC $10
+    0x9D, 0x00, 0x03,  // $020A: STA $0300,X
+    0xE6, 0x11,        // $020D: INC $11
+    0xA5, 0x11,        // $020F: LDA $11
+    0xC9, 0x40,        // $0211: CMP #$40
+    0xD0, 0x03,        // $0213: BNE $0218
+    0x8D, 0x01, 0x40,  // $0215: STA $4001, which restores the saved state
+    0x4C, 0x02, 0x02,  // $0218: JMP $0202
+  };
+
+};
+
+static bool SameState(const Host &a, const Host &b) {
+  const auto ra = a.GetRegisters();
+  const auto rb = b.GetRegisters();
+  return a.Cycles() == b.Cycles() && ra.PC == rb.PC && ra.A == rb.A && ra.X == rb.X && ra.Y == rb.Y
+      && ra.S == rb.S && ra.P == rb.P && a.restores == b.restores
+      && std::memcmp(a.memory, b.memory, sizeof(a.memory)) == 0;
+}
+
+int main() {
+  const auto inPlace = std::make_unique<Host>(false);
+  const auto mapped  = std::make_unique<Host>(true);
+
+  for (Host *host : { inPlace.get(), mapped.get() }) {
+    host->Reset();
+    host->Run(100);
+    host->SaveState(host->saved, sizeof(host->saved));
+
+    // Events step the CPU and change its registers between instructions.
+    host->Schedule(host->Cycles() + 2000, [host] { host->Step(); host->Step(); });
+    host->Schedule(host->Cycles() + 3000, [host] { host->LoadState(host->saved, sizeof(host->saved)); });
+    host->Schedule(host->Cycles() + 4000, [host] {
+      Host::Registers registers = host->GetRegisters();
+      registers.A = 0x5A;
+      registers.Y = 0xC3;
+      host->SetRegisters(registers);
+    });
+
+    host->Run(50'000);
+  }
+
+  Check(mapped->restores == 3, "the device restored the saved state");
+  Check(SameState(*inPlace, *mapped), "callbacks that change the CPU act the same on a mapped run");
+
+  return Report("callbacks");
+}
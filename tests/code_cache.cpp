@@ -0,0 +1,98 @@
+//
+// code_cache.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include "common.h"
+
+//
+// The code cache must never change what a program does: code that rewrites
+// itself through mirrors of the page it runs from, or patches an instruction
+// later in the block it is running, ends in the same state with
+// EnableCodeCache() as without it, and so does code changed through a page
+// mapped onto it later or by the host.
+//
+
+// 2 KiB of RAM at $0000 mirrored four times through $0000-$1FFF, as on the
+// NES; the rest of the address space goes through Load/Store.
+static void Boot(Machine &machine, bool cache) {
+  for (uint32_t mirror = 0x0000; mirror < 0x2000; mirror += 0x0800) {
+    machine.MapPages(static_cast<uint16_t>(mirror), 0x0800, machine.memory, machine.memory);
+  }
+  machine.EnableCodeCache(cache);
+  machine.Reset();
+}
+
+// Rewrites an operand, an opcode later in the running block and its own jump
+// target through three different mirrors, so it runs from $0200 and $1200 in
+// turn, next to a data byte on the same page.
+static void Mirrors() {
+  const std::initializer_list<uint8_t> code = {
+    0xA9, 0x00,        // $0200: LDA #$00     (operand bumped below)
+    0x18,              // $0202: CLC
+    0x65, 0x10,        // $0203: ADC $10
+    0x85, 0x10,        // $0205: STA $10
+    0xEE, 0x01, 0x0A,  // $0207: INC $0A01    ($0201 through a mirror)
+    0xEE, 0x80, 0x0A,  // $020A: INC $0A80    (data on the code page)
+    0xAD, 0x01, 0x02,  // $020D: LDA $0201
+    0x29, 0x01,        // $0210: AND #$01
+    0x0A,              // $0212: ASL A
+    0x09, 0xC8,        // $0213: ORA #$C8     (INY or DEX)
+    0x8D, 0x19, 0x12,  // $0215: STA $1219    (later in this block)
+    0xEA,              // $0218: NOP
+    0xC8,              // $0219: INY or DEX
+    0xAD, 0x24, 0x02,  // $021A: LDA $0224
+    0x49, 0x10,        // $021D: EOR #$10
+    0x8D, 0x24, 0x0A,  // $021F: STA $0A24    (the jump's high byte)
+    0x4C, 0x00, 0x02,  // $0222: JMP $0200 or $1200
+  };
+
+  static Machine plain(code, 0x0200);
+  static Machine cached(code, 0x0200);
+  Boot(plain, false);
+  Boot(cached, true);
+  plain.Run(200'000);
+  cached.Run(200'000);
+
+  Check(SameState(plain, cached), "self-modifying code through mirrors runs the same cached");
+}
+
+// Never writes its own code until the host maps $2300 onto it, and runs from
+// the $0B00 mirror while the host patches it at $0300.
+static void MappedLater() {
+  const std::initializer_list<uint8_t> code = {
+    0xA2, 0x00,        // $0B00: LDX #$00     (operand written through $2301)
+    0xE8,              // $0B02: INX          (patched by the host)
+    0x8A,              // $0B03: TXA
+    0x8D, 0x01, 0x23,  // $0B04: STA $2301
+    0x4C, 0x00, 0x0B,  // $0B07: JMP $0B00
+  };
+
+  static Machine plain(code, 0x0300);
+  static Machine cached(code, 0x0300);
+  for (Machine *machine : { &plain, &cached }) {
+    machine->memory[0xFFFD] = 0x0B;
+    Boot(*machine, machine == &cached);
+    machine->Run(100'000);
+  }
+
+  for (Machine *machine : { &plain, &cached }) {
+    machine->memory[0x0302] = 0xCA;  // DEX
+    machine->InvalidateCode(0x0300, 0x0100);
+    machine->Run(100'000);
+  }
+  Check(SameState(plain, cached), "InvalidateCode() covers the mirrors of the page");
+
+  for (Machine *machine : { &plain, &cached }) {
+    machine->MapPages(0x2300, 0x0100, machine->memory + 0x0300, machine->memory + 0x0300);
+    machine->Run(100'000);
+  }
+  Check(SameState(plain, cached), "stores through a page mapped onto cached code invalidate it");
+}
+
+int main() {
+  Mirrors();
+  MappedLater();
+
+  return Report("code_cache");
+}
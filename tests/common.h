@@ -0,0 +1,78 @@
+//
+// common.h
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include "MOS6502/MOS6502T.h"
+
+//
+// Shared by the regression tests: a machine with all 64 KiB behind
+// Load/Store, which each test maps as it needs before calling Reset(), and
+// the checks the tests report through.
+//
+
+// `code` at `origin`, with the reset vector pointing at it.
+template <typename Variant>
+class TestMachine : public MOS6502T<TestMachine<Variant>, Variant> {
+
+public:
+
+  TestMachine() = default;
+
+  TestMachine(std::initializer_list<uint8_t> code, uint16_t origin) {
+    std::copy(code.begin(), code.end(), memory + origin);
+    memory[0xFFFC] = origin & 0xFF;
+    memory[0xFFFD] = origin >> 8;
+  }
+
+  uint8_t Load(uint16_t address, bool peek = false) {
+    if (!peek) { loads++; }
+    return memory[address];
+  }
+
+  void Store(uint16_t address, uint8_t value) {
+    stores++;
+    memory[address] = value;
+  }
+
+  // Only consulted under RuntimeVariant.
+  void EnableDecimal(bool enable) { this->enableBCD = enable; }
+
+  uint8_t  memory[0x10000] = {};
+  uint64_t loads  = 0;
+  uint64_t stores = 0;
+
+};
+
+using Machine = TestMachine<Nmos6502>;
+
+static int failures = 0;
+
+static void Check(bool condition, const char *what) {
+  if (!condition) {
+    std::printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+// Registers, cycles, memory and the stores that reached the bus.
+template <typename Variant>
+static bool SameState(const TestMachine<Variant> &a, const TestMachine<Variant> &b) {
+  const auto ra = a.GetRegisters();
+  const auto rb = b.GetRegisters();
+  return a.Cycles() == b.Cycles() && ra.PC == rb.PC && ra.A == rb.A && ra.X == rb.X && ra.Y == rb.Y
+      && ra.S == rb.S && ra.P == rb.P && a.stores == b.stores
+      && std::memcmp(a.memory, b.memory, sizeof(a.memory)) == 0;
+}
+
+static int Report(const char *name) {
+  if (failures) { return 1; }
+  std::printf("%s: ok\n", name);
+  return 0;
+}
@@ -0,0 +1,125 @@
+//
+// debugger.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <memory>
+#include "common.h"
+
+//
+// Breakpoints stop Run() before the instruction at their address, and
+// watchpoints after the instruction that made the access, on mapped and
+// unmapped pages alike, without hiding the access from the bus. With
+// nothing armed, or everything cleared again, a run is the same as one that
+// never used the debugger.
+//
+
+// Pages $00-$7F mapped, the rest through Load/Store.
+static const std::initializer_list<uint8_t> CODE = {
+  0xA2, 0x00,        // $0200: LDX #$00
+  0xA5, 0x10,        // $0202: LDA $10
+  0x8D, 0x00, 0x80,  // $0204: STA $8000
+  0xAD, 0x01, 0x80,  // $0207: LDA $8001
+  0x85, 0x20,        // $020A: STA $20
+  0xE8,              // $020C: INX
+  0x4C, 0x02, 0x02,  // $020D: JMP $0202
+};
+
+static std::unique_ptr<Machine> Boot() {
+  auto machine = std::make_unique<Machine>(CODE, 0x0200);
+  machine->memory[0x10]   = 0x33;
+  machine->memory[0x8001] = 0x44;
+  machine->MapPages(0x0000, 0x8000, machine->memory, machine->memory);
+  machine->Reset();
+  return machine;
+}
+
+static void Breakpoints() {
+  auto machine = Boot();
+  machine->SetBreakpoint(0x020A);
+
+  machine->Run(10'000);
+  const auto &hit = machine->LastBreak();
+  Check(hit.cause == Machine::BREAK_EXECUTE && hit.pc == 0x020A && hit.cycle == machine->Cycles(),
+        "a breakpoint reports where and when it stopped");
+  Check(machine->GetRegisters().PC == 0x020A && machine->GetRegisters().X == 0x00,
+        "a breakpoint stops before its instruction");
+
+  machine->Run(10'000);
+  Check(machine->LastBreak().cause == Machine::BREAK_EXECUTE && machine->GetRegisters().X == 0x01,
+        "the next Run() runs the instruction and stops there on the next pass");
+
+  machine->ClearBreakpoint(0x020A);
+  machine->SetBreakpoint(0x020C, [](const Machine::Registers &registers) { return registers.X == 0x05; });
+  machine->Run(10'000);
+  Check(machine->LastBreak().cause == Machine::BREAK_EXECUTE && machine->GetRegisters().PC == 0x020C
+        && machine->GetRegisters().X == 0x05, "a conditional breakpoint stops only when its condition holds");
+}
+
+// Each watchpoint on its own machine; `pc` made the access and `next` is
+// where Run() stops.
+static void Watchpoint(uint16_t address, bool read, uint16_t pc, uint16_t next, uint8_t value, const char *what) {
+  auto machine = Boot();
+  machine->SetWatchpoint(address, 1, read, !read);
+  const uint64_t loads = machine->loads, stores = machine->stores;
+
+  machine->Run(10'000);
+  const auto hit = machine->LastBreak();
+  Check(hit.cause == (read ? Machine::BREAK_READ : Machine::BREAK_WRITE) && hit.pc == pc && hit.address == address
+        && hit.value == value && machine->GetRegisters().PC == next, what);
+
+  if (address >= 0x8000) {
+    Check(read ? machine->loads > loads : machine->stores > stores, "a watched unmapped access still reaches the bus");
+  } else if (!read) {
+    Check(machine->memory[address] == value, "a watched mapped write still lands in memory");
+  }
+
+  machine->Run(10'000);
+  Check(machine->LastBreak().cause == hit.cause && machine->GetRegisters().X == 0x01,
+        "a watchpoint stops again on the next pass");
+}
+
+// Watching one address moves its page off the mapped path; other accesses
+// to that page must not stop.
+static void Neighbours() {
+  auto machine = Boot();
+  machine->SetWatchpoint(0x0030, 1, true, true);
+  machine->SetWatchpoint(0x8030, 1, true, true);
+  machine->Run(10'000);
+  Check(machine->LastBreak().cause == Machine::BREAK_NONE && machine->Cycles() >= 10'000,
+        "accesses beside a watched address do not stop");
+  Check(machine->memory[0x20] == 0x44, "a watched page still reads and writes through its mapping");
+}
+
+// Nothing armed, and everything armed then cleared, runs the budget through
+// exactly as a machine that never armed anything.
+static void Unarmed() {
+  auto plain   = Boot();
+  auto cleared = Boot();
+  cleared->SetBreakpoint(0x0204);
+  cleared->SetWatchpoint(0x0010, 1, true, true);
+  cleared->SetWatchpoint(0x8000, 2, true, true);
+  cleared->ClearBreakpoints();
+
+  plain->Run(10'000);
+  cleared->Run(10'000);
+  Check(plain->LastBreak().cause == Machine::BREAK_NONE && cleared->LastBreak().cause == Machine::BREAK_NONE,
+        "nothing armed never stops");
+  Check(plain->Cycles() >= 10'000, "nothing armed runs the whole budget");
+  Check(SameState(*plain, *cleared) && plain->loads == cleared->loads,
+        "a cleared debugger runs exactly as one never armed");
+}
+
+int main() {
+  Breakpoints();
+
+  Watchpoint(0x0010, true,  0x0202, 0x0204, 0x33, "a read watchpoint on a mapped page stops after the read");
+  Watchpoint(0x0020, false, 0x020A, 0x020C, 0x44, "a write watchpoint on a mapped page stops after the write");
+  Watchpoint(0x8001, true,  0x0207, 0x020A, 0x44, "a read watchpoint on an unmapped page stops after the read");
+  Watchpoint(0x8000, false, 0x0204, 0x0207, 0x33, "a write watchpoint on an unmapped page stops after the write");
+
+  Neighbours();
+  Unarmed();
+
+  return Report("debugger");
+}
@@ -0,0 +1,106 @@
+//
+// idle_skip.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <memory>
+#include "common.h"
+
+//
+// Idle-loop fast-forward must never change what a program does: a run with
+// EnableIdleSkip() ends in the same state, with the same bus traffic through
+// Store(), as the same run without it.
+//
+
+// Code at $0400 in mapped RAM; page 0 goes through Load/Store and is counted.
+static void Boot(Machine &machine, bool skip) {
+  machine.MapPages(0x0100, 0xFF00, machine.memory + 0x0100, machine.memory + 0x0100);
+  machine.MarkIdempotent(0x0010, 1);
+  machine.EnableIdleSkip(skip);
+  machine.Reset();
+}
+
+// A real polling loop is skipped, and leaves when an event changes what it
+// polls, on the same cycle as without skipping.
+static void PollingLoop() {
+  const std::initializer_list<uint8_t> code = {
+    0xA5, 0x10,        // $0400: LDA $10
+    0xF0, 0xFC,        // $0402: BEQ $0400
+    0x85, 0x20,        // $0404: STA $20
+    0x4C, 0x06, 0x04,  // $0406: JMP $0406
+  };
+
+  static Machine plain(code, 0x0400);
+  static Machine skip(code, 0x0400);
+  for (Machine *machine : { &plain, &skip }) {
+    Boot(*machine, machine == &skip);
+    machine->Schedule(500'000, [machine] { machine->memory[0x10] = 0x42; });
+    machine->Run(1'000'000);
+  }
+
+  Check(skip.loads < plain.loads / 100, "polling loop is skipped");
+  Check(skip.stores == 1 && plain.stores == 1, "polling loop exit stores once");
+  Check(SameState(plain, skip), "polling loop ends in the same state with idle skip");
+}
+
+// A loop that branches into the operand of BIT abs (the skip-byte idiom)
+// runs a hidden STA $20 every iteration, so it is not idle.
+static void HiddenStore() {
+  const std::initializer_list<uint8_t> code = {
+    0xA5, 0x10,        // $0400: LDA $10
+    0xF0, 0x01,        // $0402: BEQ $0405
+    0x2C, 0x85, 0x20,  // $0404: BIT $2085, or STA $20 from $0405
+    0x4C, 0x00, 0x04,  // $0407: JMP $0400
+  };
+
+  static Machine plain(code, 0x0400);
+  static Machine skip(code, 0x0400);
+  for (Machine *machine : { &plain, &skip }) {
+    Boot(*machine, machine == &skip);
+    machine->Run(1'000'000);
+  }
+
+  Check(skip.stores == plain.stores, "a branch into an operand hides a store from the idle-loop scan");
+  Check(SameState(plain, skip), "hidden-store loop ends in the same state with idle skip");
+}
+
+// Code across the end of page 2 with page 3 on the bus, so a branch's dummy
+// reads beyond the loop are counted: the byte after it and, as it crosses
+// back into page 2, the target's offset in page 3.
+static void DummyReads(std::initializer_list<uint8_t> code, uint16_t origin, const char *what) {
+  const auto plain = std::make_unique<Machine>(code, origin);
+  const auto skip  = std::make_unique<Machine>(code, origin);
+  for (Machine *machine : { plain.get(), skip.get() }) {
+    machine->MapPages(0x0100, 0x0200, machine->memory + 0x0100, machine->memory + 0x0100);
+    machine->MarkIdempotent(0x0010, 1);
+    machine->MarkIdempotent(0x0300, 4);
+    machine->EnableIdleSkip(machine == skip.get());
+    machine->Reset();
+    machine->Schedule(500'000, [machine] { machine->memory[0x10] = 0x42; });
+    machine->Run(1'000'000);
+  }
+
+  Check(skip->loads == plain->loads, what);
+  Check(SameState(*plain, *skip), "a loop with dummy reads on the bus ends in the same state with idle skip");
+}
+
+int main() {
+  PollingLoop();
+  HiddenStore();
+
+  DummyReads({
+    0xA5, 0x10,        // $02FC: LDA $10
+    0xF0, 0xFC,        // $02FE: BEQ $02FC, reading $0300 and $03FC when taken
+    0x85, 0x20,        // $0300: STA $20
+    0x4C, 0x02, 0x03,  // $0302: JMP $0302
+  }, 0x02FC, "the byte after the closing branch is read on the bus");
+
+  DummyReads({
+    0xA5, 0x10,        // $02FE: LDA $10
+    0xF0, 0xFC,        // $0300: BEQ $02FE, reading $0302 and $03FE when taken
+    0x85, 0x20,        // $0302: STA $20
+    0x4C, 0x04, 0x03,  // $0304: JMP $0304
+  }, 0x02FE, "the page-crossing read of the closing branch is read on the bus");
+
+  return Report("idle_skip");
+}
@@ -0,0 +1,154 @@
+//
+// input_log.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include "common.h"
+
+//
+// A replayed InputLog must reproduce the recorded run exactly, from the same
+// starting state, with the devices that fed it gone: registers, memory and
+// cycle count all match, and nothing is read from the absent devices.
+//
+
+// RAM everywhere but page $40, where a device returns a new value from
+// $4000 on every read and acknowledges the IRQ on a read of $4001.
+class Console : public MOS6502T<Console, Nmos6502> {
+
+public:
+
+  Console() {
+    std::copy(PROGRAM.begin(), PROGRAM.end(), memory + 0x0200);
+    std::copy(HANDLERS.begin(), HANDLERS.end(), memory + 0x0220);
+    memory[0xFFFA] = 0x30; memory[0xFFFB] = 0x02;
+    memory[0xFFFC] = 0x00; memory[0xFFFD] = 0x02;
+    memory[0xFFFE] = 0x20; memory[0xFFFF] = 0x02;
+    MapPages(0x0000, 0x4000, memory, memory);
+    MapPages(0x4100, 0xBF00, memory + 0x4100, memory + 0x4100);
+  }
+
+  uint8_t Load(uint16_t address, bool peek = false) {
+    if ((address >> 8) != 0x40) { return memory[address]; }
+    if (!peek) { deviceReads++; }
+    if (!attached) {
+      absentReads++;
+      return 0xEE;
+    }
+    if (address == 0x4001) {
+      Signal(IRQ, false);
+      return 0x00;
+    }
+    if (!peek) { seed = seed * 1103515245 + 12345; }
+    return static_cast<uint8_t>(seed >> 16);
+  }
+
+  void Store(uint16_t address, uint8_t value) {
+    memory[address] = value;
+  }
+
+  uint8_t  memory[0x10000] = {};
+  bool     attached = true;
+  uint32_t seed = 1;
+  uint64_t deviceReads = 0;
+  uint64_t absentReads = 0;
+
+private:
+
+  // Sums device values into $10 and a table at $0300,X.
+  static constexpr std::initializer_list<uint8_t> PROGRAM = {
+    0x58,              // $0200: CLI
+    0xAD, 0x00, 0x40,  // $0201: LDA $4000
+    0x18,              // $0204: CLC
+    0x65, 0x10,        // $0205: ADC $10
+    0x85, 0x10,        // $0207: STA $10
+    0xE8,              // $0209: INX
+    0x9D, 0x00, 0x03,  // $020A: STA $0300,X
+    0x4C, 0x01, 0x02,  // $020D: JMP $0201
+  };
+
+  // IRQ at $0220 counts into $11 and acknowledges; NMI at $0230 counts
+  // into $13 and keeps a device value at $14.
+  static constexpr std::initializer_list<uint8_t> HANDLERS = {
+    0xE6, 0x11,        // $0220: INC $11
+    0xAD, 0x01, 0x40,  // $0222: LDA $4001
+    0x45, 0x12,        // $0225: EOR $12
+    0x85, 0x12,        // $0227: STA $12
+    0x40,              // $0229: RTI
+    0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA,  // $022A: NOP padding
+    0xE6, 0x13,        // $0230: INC $13
+    0xAD, 0x00, 0x40,  // $0232: LDA $4000
+    0x85, 0x14,        // $0235: STA $14
+    0x40,              // $0237: RTI
+  };
+
+};
+
+static bool SameState(const Console &a, const Console &b) {
+  const auto ra = a.GetRegisters();
+  const auto rb = b.GetRegisters();
+  return a.Cycles() == b.Cycles() && ra.PC == rb.PC && ra.A == rb.A && ra.X == rb.X && ra.Y == rb.Y
+      && ra.S == rb.S && ra.P == rb.P && std::memcmp(a.memory, b.memory, sizeof(a.memory)) == 0;
+}
+
+int main() {
+  const auto recorded = std::make_unique<Console>();
+  const auto replayed = std::make_unique<Console>();
+  replayed->attached = false;
+
+  InputLog log;
+  log.MarkNondeterministic(0x4000, 2);
+
+  // Record, with the lines raised between slices at chosen cycles.
+  recorded->Reset();
+  uint8_t start[Console::STATE_SIZE];
+  Check(recorded->SaveState(start, sizeof(start)) == Console::STATE_SIZE, "the starting state saves");
+  Check(recorded->Record(&log), "recording starts");
+
+  const std::pair<uint64_t, Console::INTERRUPT> signals[] = {
+    { 1000, Console::IRQ }, { 2500, Console::NMI }, { 4000, Console::IRQ }, { 5200, Console::NMI },
+  };
+  for (const auto &[cycle, interrupt] : signals) {
+    recorded->Run(cycle - recorded->Cycles());
+    recorded->Signal(interrupt, true);
+  }
+  recorded->Run(10'000 - recorded->Cycles());
+  recorded->Record(nullptr);
+
+  Check(log.Interrupts() == 4, "every interrupt taken is logged");
+  Check(log.Values() == recorded->deviceReads, "every marked read is logged");
+  Check(recorded->memory[0x11] == 2 && recorded->memory[0x13] == 2, "both handlers ran twice");
+
+  // Save() and Load() round-trip, and Load() refuses a damaged log.
+  const std::vector<uint8_t> blob = log.Save();
+  InputLog loaded;
+  Check(loaded.Load(blob.data(), blob.size()), "a saved log loads");
+  Check(loaded.Save() == blob, "a loaded log saves the same bytes");
+  Check(!loaded.Load(blob.data(), blob.size() - 1), "a truncated log is refused");
+  Check(!loaded.Load(blob.data(), 8), "a truncated header is refused");
+  std::vector<uint8_t> renamed = blob;
+  renamed[0] = 'X';
+  Check(!loaded.Load(renamed.data(), renamed.size()), "a log with the wrong magic is refused");
+  Check(loaded.Save() == blob, "a refused load leaves the log unchanged");
+
+  // Replay from the same start with the devices gone; a stray Signal() is
+  // ignored.
+  Check(replayed->LoadState(start, sizeof(start)) == Console::STATE_SIZE, "the starting state loads");
+  Check(replayed->Replay(&loaded), "replay starts");
+  replayed->Signal(Console::NMI, true);
+  replayed->Run(recorded->Cycles() - replayed->Cycles());
+  replayed->Replay(nullptr);
+
+  Check(loaded.Finished(), "the whole log is replayed");
+  Check(replayed->absentReads == 0, "replay reads nothing from the absent devices");
+  Check(SameState(*recorded, *replayed), "replay ends in the recorded state on the recorded cycle");
+
+  // A log that marks a mapped page is refused.
+  InputLog mapped;
+  mapped.MarkNondeterministic(0x0010, 1);
+  Check(!replayed->Record(&mapped) && !replayed->Replay(&mapped), "a log marking a mapped page is refused");
+
+  return Report("input_log");
+}
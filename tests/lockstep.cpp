@@ -0,0 +1,231 @@
+//
+// lockstep.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <memory>
+#include "common.h"
+#include "MOS6502/Lockstep.h"
+
+//
+// Every lane run in lockstep must end in exactly the state, with the same
+// cycle count, as the same machine run on its own: registers, memory and
+// cycles, and its trace or profile when it keeps one. The lanes take
+// different inputs, honour decimal mode or not, and split at a branch and
+// join again, so groups form, break up and re-form; they read and write
+// memory in every addressing mode, rewrite their own code, take events and
+// run without mapped pages.
+//
+
+using Lane = TestMachine<RuntimeVariant>;
+
+static constexpr size_t   LANES  = 8;
+static constexpr uint64_t SLICES = 4;
+static constexpr uint64_t BUDGET = 2000;
+
+// Decimal ADC and SBC on a per-lane input at $00, stored, then a branch on
+// the result that skips three instructions in some lanes, forever.
+static const std::initializer_list<uint8_t> CODE = {
+  0xA2, 0x00,        // $0200: LDX #$00
+  0xA5, 0x00,        // $0202: LDA $00
+  0xF8,              // $0204: SED
+  0x18,              // $0205: CLC
+  0x69, 0x19,        // $0206: ADC #$19
+  0x38,              // $0208: SEC
+  0xE9, 0x07,        // $0209: SBC #$07
+  0xD8,              // $020B: CLD
+  0x95, 0x10,        // $020C: STA $10,X
+  0xA8,              // $020E: TAY
+  0x29, 0x03,        // $020F: AND #$03
+  0xF0, 0x04,        // $0211: BEQ $0217
+  0xC8,              // $0213: INY
+  0x2A,              // $0214: ROL A
+  0x49, 0x5A,        // $0215: EOR #$5A
+  0xE8,              // $0217: INX
+  0xE0, 0x08,        // $0218: CPX #$08
+  0xD0, 0xE6,        // $021A: BNE $0202
+  0xE6, 0x00,        // $021C: INC $00
+  0x4C, 0x00, 0x02,  // $021E: JMP $0200
+};
+
+// Every addressing mode, reading, writing and modifying, on per-lane data at
+// $00 with indexed accesses that cross into $0400 in some lanes, then a
+// store into the operand of the ADC that follows it, forever.
+static const std::initializer_list<uint8_t> MEMORY = {
+  0xA5, 0x00,        // $0200: LDA $00
+  0x29, 0x0F,        // $0202: AND #$0F
+  0xA8,              // $0204: TAY
+  0xAA,              // $0205: TAX
+  0xA9, 0xF8,        // $0206: LDA #$F8
+  0x85, 0x20,        // $0208: STA $20
+  0xA9, 0x03,        // $020A: LDA #$03
+  0x85, 0x21,        // $020C: STA $21
+  0xA5, 0x00,        // $020E: LDA $00
+  0x91, 0x20,        // $0210: STA ($20),Y
+  0xB1, 0x20,        // $0212: LDA ($20),Y
+  0x79, 0xF8, 0x03,  // $0214: ADC $03F8,Y
+  0x9D, 0xF8, 0x03,  // $0217: STA $03F8,X
+  0x1E, 0xF8, 0x03,  // $021A: ASL $03F8,X
+  0xBD, 0xF8, 0x03,  // $021D: LDA $03F8,X
+  0x95, 0x30,        // $0220: STA $30,X
+  0xF6, 0x30,        // $0222: INC $30,X
+  0xB6, 0x30,        // $0224: LDX $30,Y
+  0x96, 0x50,        // $0226: STX $50,Y
+  0xA2, 0x00,        // $0228: LDX #$00
+  0xA1, 0x20,        // $022A: LDA ($20,X)
+  0x81, 0x20,        // $022C: STA ($20,X)
+  0x6D, 0x00, 0x04,  // $022E: ADC $0400
+  0x8D, 0x01, 0x04,  // $0231: STA $0401
+  0xEE, 0x02, 0x04,  // $0234: INC $0402
+  0x46, 0x40,        // $0237: LSR $40
+  0x24, 0x40,        // $0239: BIT $40
+  0xC5, 0x00,        // $023B: CMP $00
+  0xCD, 0x01, 0x04,  // $023D: CMP $0401
+  0x8D, 0x44, 0x02,  // $0240: STA $0244
+  0x69, 0x00,        // $0243: ADC #$00
+  0xE6, 0x00,        // $0245: INC $00
+  0x4C, 0x00, 0x02,  // $0247: JMP $0200
+};
+
+template <typename Variant>
+static void Boot(TestMachine<Variant> &machine, size_t lane) {
+  machine.memory[0x00] = static_cast<uint8_t>(lane * 37 + 1);
+  machine.EnableDecimal(lane % 2 == 0);
+  machine.MapPages(0x0000, 0x10000, machine.memory, machine.memory);
+  machine.Reset();
+}
+
+static bool SameTrace(const TraceBuffer &a, const TraceBuffer &b) {
+  static TraceRecord ra[1 << 14], rb[1 << 14];
+  const size_t count = a.Snapshot(ra, 1 << 14);
+  if (count == 0 || count != b.Snapshot(rb, 1 << 14) || a.Count() != b.Count()) { return false; }
+  for (size_t index = 0; index < count; index++) {
+    const TraceRecord &x = ra[index], &y = rb[index];
+    if (x.cycle != y.cycle || x.pc != y.pc || x.opcode != y.opcode || x.A != y.A || x.X != y.X
+        || x.Y != y.Y || x.P != y.P || x.S != y.S) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Variant>
+static bool SameProfile(const TestMachine<Variant> &a, const TestMachine<Variant> &b) {
+  for (int opcode = 0; opcode < 0x100; opcode++) {
+    const auto &x = a.OpcodeProfile(static_cast<uint8_t>(opcode));
+    const auto &y = b.OpcodeProfile(static_cast<uint8_t>(opcode));
+    if (x.executed != y.executed || x.cycles != y.cycles) { return false; }
+  }
+  for (uint32_t pc = 0x0200; pc < 0x0200 + CODE.size(); pc++) {
+    if (a.ExecutedAt(static_cast<uint16_t>(pc)) != b.ExecutedAt(static_cast<uint16_t>(pc))) { return false; }
+  }
+  return true;
+}
+
+int main() {
+  // Each lane on its own against the same lanes in lockstep, a slice at a
+  // time, with lane 0 traced.
+  {
+    std::array<std::unique_ptr<Lane>, LANES> alone, grouped;
+    std::array<Lane *, LANES> lanes;
+    for (size_t lane = 0; lane < LANES; lane++) {
+      alone[lane]   = std::make_unique<Lane>(CODE, 0x0200);
+      grouped[lane] = std::make_unique<Lane>(CODE, 0x0200);
+      Boot(*alone[lane], lane);
+      Boot(*grouped[lane], lane);
+      lanes[lane] = grouped[lane].get();
+    }
+
+    TraceBuffer traceAlone(1 << 14), traceGrouped(1 << 14);
+    alone[0]->SetTrace(&traceAlone);
+    grouped[0]->SetTrace(&traceGrouped);
+
+    Lockstep<Lane, LANES> lockstep(lanes);
+    for (uint64_t slice = 0; slice < SLICES; slice++) {
+      for (auto &machine : alone) { machine->Run(BUDGET); }
+      lockstep.Run(BUDGET);
+      for (size_t lane = 0; lane < LANES; lane++) {
+        Check(SameState(*alone[lane], *grouped[lane]), "each lane ends where it would on its own");
+      }
+    }
+
+    Check(SameTrace(traceAlone, traceGrouped), "a traced lane records every instruction it runs");
+    Check(lockstep.GetStats().vectorCycles > 0, "groups run across lanes");
+    Check(lockstep.GetStats().scalarCycles > 0, "a traced lane runs on its own core");
+  }
+
+  // Memory in every mode, with lane 1 taking an event partway through and
+  // lane 2 left on its bus.
+  {
+    std::array<std::unique_ptr<Lane>, LANES> alone, grouped;
+    std::array<Lane *, LANES> lanes;
+    for (size_t lane = 0; lane < LANES; lane++) {
+      alone[lane]   = std::make_unique<Lane>(MEMORY, 0x0200);
+      grouped[lane] = std::make_unique<Lane>(MEMORY, 0x0200);
+      for (Lane *machine : { alone[lane].get(), grouped[lane].get() }) {
+        Boot(*machine, lane);
+        if (lane == 2) { machine->UnmapPages(0x0000, 0x10000); }
+        if (lane == 1) { machine->Schedule(machine->Cycles() + 777, [machine] { machine->memory[0x60]++; }); }
+      }
+      lanes[lane] = grouped[lane].get();
+    }
+
+    Lockstep<Lane, LANES> lockstep(lanes);
+    for (uint64_t slice = 0; slice < SLICES; slice++) {
+      for (auto &machine : alone) { machine->Run(BUDGET); }
+      lockstep.Run(BUDGET);
+      for (size_t lane = 0; lane < LANES; lane++) {
+        Check(SameState(*alone[lane], *grouped[lane]), "each lane reads and writes memory as it would on its own");
+      }
+    }
+
+    Check(grouped[1]->memory[0x60] == 1, "a lane takes its event");
+    Check(lockstep.GetStats().vectorCycles > lockstep.GetStats().scalarCycles, "memory operands run across lanes");
+  }
+
+  // Profiled<> lanes count every instruction, as they would on their own.
+  {
+    using ProfiledLane = TestMachine<Profiled<Nmos6502>>;
+    std::array<std::unique_ptr<ProfiledLane>, 2> alone, grouped;
+    std::array<ProfiledLane *, 2> lanes;
+    for (size_t lane = 0; lane < 2; lane++) {
+      alone[lane]   = std::make_unique<ProfiledLane>(CODE, 0x0200);
+      grouped[lane] = std::make_unique<ProfiledLane>(CODE, 0x0200);
+      Boot(*alone[lane], lane);
+      Boot(*grouped[lane], lane);
+      lanes[lane] = grouped[lane].get();
+    }
+
+    Lockstep<ProfiledLane, 2> lockstep(lanes);
+    for (auto &machine : alone) { machine->Run(BUDGET); }
+    lockstep.Run(BUDGET);
+    for (size_t lane = 0; lane < 2; lane++) {
+      Check(SameState(*alone[lane], *grouped[lane]), "a profiled lane ends where it would on its own");
+      Check(SameProfile(*alone[lane], *grouped[lane]), "a profiled lane counts every instruction");
+    }
+  }
+
+  // An implied opcode groups whatever follows it, and an immediate one
+  // groups lanes whatever their operands.
+  {
+    static Machine nop1({ 0xEA, 0xA9, 0x01 }, 0x0200), nop2({ 0xEA, 0xA2, 0x02 }, 0x0200);
+    static Machine lda1({ 0xA9, 0x01 }, 0x0200), lda2({ 0xA9, 0x02 }, 0x0200);
+    for (Machine *machine : { &nop1, &nop2, &lda1, &lda2 }) {
+      machine->MapPages(0x0000, 0x10000, machine->memory, machine->memory);
+      machine->Reset();
+    }
+
+    Lockstep<Machine, 2> nops({ &nop1, &nop2 });
+    nops.Run(2);
+    Check(nops.GetStats().vectorCycles == 4 && nops.GetStats().scalarCycles == 0,
+          "an implied opcode does not compare the next byte");
+
+    Lockstep<Machine, 2> loads({ &lda1, &lda2 });
+    loads.Run(2);
+    Check(loads.GetStats().vectorCycles == 4 && loads.GetStats().scalarCycles == 0,
+          "an immediate opcode runs across lanes with different operands");
+    Check(lda1.GetRegisters().A == 0x01 && lda2.GetRegisters().A == 0x02, "each lane loads its own operand");
+  }
+
+  return Report("lockstep");
+}
@@ -0,0 +1,125 @@
+//
+// opcodes.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <cstdio>
+#include "common.h"
+
+//
+// The effect column of the opcode table must say what each opcode does to
+// the bus when it runs: every known opcode is stepped once with its memory
+// operand at a watched address, and the reads, writes, stack accesses and
+// change of flow it made are checked against OPCODE_INFO.
+//
+
+// Data at $40 for zero-page operands and at $3000 for the rest, reached
+// through a pointer at $80 by the indirect modes; X and Y stay 0.
+static constexpr uint16_t ORIGIN  = 0x0200;
+static constexpr uint8_t  ZPDATA  = 0x40;
+static constexpr uint16_t DATA    = 0x3000;
+static constexpr uint8_t  POINTER = 0x80;
+
+class Probe : public MOS6502T<Probe, Nmos6502Illegal> {
+
+public:
+
+  uint8_t Load(uint16_t address, bool peek = false) {
+    if (!peek) { Touch(address, false); }
+    return memory[address];
+  }
+
+  void Store(uint16_t address, uint8_t value) {
+    Touch(address, true);
+    if (address == ZPDATA || address == DATA) { stored = value; }
+    memory[address] = value;
+  }
+
+  uint8_t memory[0x10000] = {};
+  bool    read = false, wrote = false, stack = false;
+  uint8_t stored = 0;  // last value written to the data
+
+private:
+
+  void Touch(uint16_t address, bool write) {
+    if (address == ZPDATA || address == DATA) { (write ? wrote : read) = true; }
+    if ((address >> 8) == 0x01) { stack = true; }
+  }
+
+};
+
+struct Observed {
+  bool    read, wrote, stack, jumped;
+  uint8_t stored;
+};
+
+static Observed Observe(uint8_t opcode, uint8_t status, uint8_t data) {
+  static Probe probe;
+  const OpcodeInfo &info = OPCODE_INFO[opcode];
+
+  std::memset(probe.memory, 0, sizeof(probe.memory));
+  probe.memory[ORIGIN] = opcode;
+  switch (info.mode) {
+    case OpcodeInfo::ZPG: case OpcodeInfo::ZPX: case OpcodeInfo::ZPY:
+      probe.memory[ORIGIN + 1] = ZPDATA;
+      break;
+    case OpcodeInfo::IZX: case OpcodeInfo::IZY:
+      probe.memory[ORIGIN + 1] = POINTER;
+      break;
+    case OpcodeInfo::REL:
+      probe.memory[ORIGIN + 1] = 0x10;
+      break;
+    default:
+      probe.memory[ORIGIN + 1] = DATA & 0xFF;
+      probe.memory[ORIGIN + 2] = DATA >> 8;
+      break;
+  }
+  probe.memory[POINTER]     = DATA & 0xFF;
+  probe.memory[POINTER + 1] = DATA >> 8;
+  probe.memory[ZPDATA]      = data;
+  probe.memory[DATA]        = data;
+
+  probe.SetRegisters({ ORIGIN, 0x00, 0x00, 0x00, 0xFF, status });
+  probe.read = probe.wrote = probe.stack = false;
+  probe.Step();
+
+  const bool jumped = probe.GetRegisters().PC != ORIGIN + info.size;
+  return { probe.read, probe.wrote, probe.stack, jumped, probe.stored };
+}
+
+static OpcodeInfo::EFFECT Classify(uint8_t opcode) {
+  bool read = false, wrote = false, stack = false, jumped = false, modified = false;
+  for (uint8_t status : { 0x00, 0xFF }) {
+    const Observed zero = Observe(opcode, status, 0x00);
+    const Observed other = Observe(opcode, status, 0x5A);
+    read   |= zero.read || other.read;
+    wrote  |= zero.wrote || other.wrote;
+    stack  |= zero.stack || other.stack;
+    jumped |= zero.jumped || other.jumped;
+
+    // A plain store writes the same value whatever was there before.
+    modified |= zero.wrote && zero.stored != other.stored;
+  }
+
+  if (jumped)   { return OpcodeInfo::FLOW; }
+  if (stack)    { return OpcodeInfo::STACK; }
+  if (modified) { return OpcodeInfo::MODIFY; }
+  if (wrote)    { return OpcodeInfo::WRITE; }
+  if (read)     { return OpcodeInfo::READ; }
+  return OpcodeInfo::NONE;
+}
+
+int main() {
+  for (int opcode = 0; opcode < 0x100; opcode++) {
+    const OpcodeInfo &info = OPCODE_INFO[opcode];
+    if (info.kind == OpcodeInfo::UNKNOWN) { continue; }
+
+    if (Classify(static_cast<uint8_t>(opcode)) != info.effect) {
+      char what[64];
+      std::snprintf(what, sizeof(what), "$%02X %s has the effect the table gives it", opcode, info.mnemonic);
+      Check(false, what);
+    }
+  }
+
+  return Report("opcodes");
+}
@@ -0,0 +1,74 @@
+//
+// profiler.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include "common.h"
+
+//
+// A loop whose every count is known in advance must profile to exactly
+// those counts, per opcode and per PC, on the in-place and the mapped core,
+// and ProfileReport() must show them.
+//
+
+using Profiled6502 = TestMachine<Profiled<Nmos6502>>;
+
+// 32 passes over a table straddling a page: the last 16 reads cross into
+// $0300, and the loop branch crosses back from $0302 to $02FA each time it
+// is taken. Ends on JMP $0302.
+static const std::initializer_list<uint8_t> CODE = {
+  0xA2, 0x00,        // $02F8: LDX #$00
+  0xBD, 0xF0, 0x02,  // $02FA: LDA $02F0,X
+  0xE8,              // $02FD: INX
+  0xE0, 0x20,        // $02FE: CPX #$20
+  0xD0, 0xF8,        // $0300: BNE $02FA
+  0x4C, 0x02, 0x03,  // $0302: JMP $0302
+};
+
+static std::string ReportText(const Profiled6502 &machine) {
+  std::FILE *file = std::tmpfile();
+  machine.ProfileReport(file);
+  std::rewind(file);
+  std::string text;
+  for (int c; (c = std::fgetc(file)) != EOF; ) { text += static_cast<char>(c); }
+  std::fclose(file);
+  return text;
+}
+
+static void Loop(bool mapped) {
+  const auto machine = std::make_unique<Profiled6502>(CODE, 0x02F8);
+  if (mapped) { machine->MapPages(0x0000, 0x10000, machine->memory, machine->memory); }
+  machine->Reset();
+  machine->ResetProfile();
+  while (machine->GetRegisters().PC != 0x0302) { machine->Run(1); }
+
+  const auto &lda = machine->OpcodeProfile(0xBD);
+  const auto &bne = machine->OpcodeProfile(0xD0);
+  Check(machine->OpcodeProfile(0xA2).executed == 1 && lda.executed == 32 && bne.executed == 32
+        && machine->OpcodeProfile(0xE8).executed == 32 && machine->OpcodeProfile(0xE0).executed == 32,
+        "each opcode's executions are counted");
+  Check(lda.pageCrossed == 16 && lda.cycles == 32 * 4 + 16, "indexed reads that cross a page pay and are counted");
+  Check(bne.taken == 31 && bne.notTaken == 1, "branches count taken and not taken");
+  Check(bne.pageCrossed == 31 && bne.cycles == 31 * 4 + 2, "taken branches that cross a page pay and are counted");
+  Check(machine->ExecutedAt(0x02FA) == 32 && machine->CyclesAt(0x02FA) == lda.cycles
+        && machine->ExecutedAt(0x0300) == 32 && machine->CyclesAt(0x0300) == bne.cycles,
+        "each PC's executions and cycles are counted");
+
+  const std::string report = ReportText(*machine);
+  Check(report.find("BD LDA              32            144") != std::string::npos
+        && report.find("D0 BNE              31              1           31") != std::string::npos,
+        "ProfileReport() lists the opcodes and branches");
+
+  machine->ResetProfile();
+  Check(!machine->OpcodeProfile(0xBD).executed && !machine->ExecutedAt(0x02FA), "ResetProfile() clears the counters");
+}
+
+int main() {
+  Loop(false);
+  Loop(true);
+
+  return Report("profiler");
+}
@@ -0,0 +1,113 @@
+//
+// request_halt.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "common.h"
+
+//
+// Another thread pulses NMI and then halts an unbounded Run(), on the
+// in-place and the mapped core. Run() must come back at an instruction
+// boundary, having taken the NMI exactly once.
+//
+
+// Page $40 is a device: the main loop writes X to $4001 each pass, and the
+// NMI handler writes to $4000.
+class Host : public MOS6502T<Host, Nmos6502> {
+
+public:
+
+  explicit Host(bool mapped) {
+    std::copy(CODE.begin(), CODE.end(), memory + 0x0200);
+    std::copy(HANDLER.begin(), HANDLER.end(), memory + 0x0300);
+    memory[0xFFFA] = 0x00; memory[0xFFFB] = 0x03;
+    memory[0xFFFC] = 0x00; memory[0xFFFD] = 0x02;
+    if (mapped) {
+      MapPages(0x0000, 0x4000, memory, memory);
+      MapPages(0x4100, 0xBF00, memory + 0x4100, memory + 0x4100);
+    }
+  }
+
+  uint8_t Load(uint16_t address, bool = false) {
+    return memory[address];
+  }
+
+  void Store(uint16_t address, uint8_t value) {
+    if (address == 0x4000) { nmis++; }
+    if (address == 0x4001) { stored = value; passes++; }
+    memory[address] = value;
+  }
+
+  uint8_t memory[0x10000] = {};
+  uint8_t stored = 0;
+  std::atomic<uint64_t> passes = 0;
+  std::atomic<uint32_t> nmis = 0;
+
+private:
+
+  static constexpr std::initializer_list<uint8_t> CODE = {
+    0xE8,              // $0200: INX
+    0x8E, 0x01, 0x40,  // $0201: STX $4001
+    0x4C, 0x00, 0x02,  // $0204: JMP $0200
+  };
+
+  static constexpr std::initializer_list<uint8_t> HANDLER = {
+    0x8D, 0x00, 0x40,  // $0300: STA $4000
+    0x40,              // $0303: RTI
+  };
+
+};
+
+// Waits up to a few seconds for `done`, so a broken core fails instead of
+// hanging the test.
+template <typename Condition>
+static bool WaitFor(Condition done) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline) { return false; }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+static void Halt(bool mapped) {
+  const auto host = std::make_unique<Host>(mapped);
+  host->Reset();
+
+  bool timely = true;
+  std::thread other([&] {
+    timely &= WaitFor([&] { return host->passes > 10'000; });
+    host->Signal(Host::NMI, true);
+    timely &= WaitFor([&] { return host->nmis > 0; });
+    host->Signal(Host::NMI, false);
+    const uint64_t passes = host->passes;
+    timely &= WaitFor([&] { return host->passes > passes + 10'000; });
+    host->RequestHalt();
+  });
+
+  host->Run();
+  other.join();
+
+  const auto registers = host->GetRegisters();
+  const bool looping = registers.PC == 0x0200 || registers.PC == 0x0201 || registers.PC == 0x0204;
+  const uint8_t x = static_cast<uint8_t>(host->stored + (registers.PC == 0x0201));
+
+  Check(timely, "the CPU ran, took the NMI and kept running before the halt");
+  Check(looping && registers.X == x, "RequestHalt() stops Run() at an instruction boundary");
+  Check(host->nmis == 1, "a pulsed NMI is taken once");
+
+  const uint64_t passes = host->passes;
+  for (int steps = 0; steps < 1000; steps++) { host->Step(); }
+  Check(host->nmis == 1 && host->passes > passes, "the NMI is not taken again after the halt");
+}
+
+int main() {
+  Halt(false);
+  Halt(true);
+
+  return Report("request_halt");
+}
@@ -0,0 +1,115 @@
+//
+// rewind.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <vector>
+#include "common.h"
+#include "MOS6502/Rewind.h"
+
+//
+// Stepping back must land on exactly the state the machine had at that
+// instruction boundary the first time through, including when the way back
+// crosses one or more keyframes, and a refused step must leave the machine
+// and its history alone.
+//
+
+// Fills memory through $0300-$07FF and a counter at $10, forever, with all
+// 64 KiB mapped so every store goes through the journal.
+static const std::initializer_list<uint8_t> CODE = {
+  0xE8,              // $0200: INX
+  0x8A,              // $0201: TXA
+  0x95, 0x40,        // $0202: STA $40,X
+  0xF6, 0x80,        // $0204: INC $80,X
+  0x9D, 0x00, 0x03,  // $0206: STA $0300,X
+  0xFE, 0x00, 0x04,  // $0209: INC $0400,X
+  0x91, 0x10,        // $020C: STA ($10),Y
+  0xC8,              // $020E: INY
+  0xD0, 0xEF,        // $020F: BNE $0200
+  0xE6, 0x11,        // $0211: INC $11
+  0x4C, 0x00, 0x02,  // $0213: JMP $0200
+};
+
+static void Boot(Machine &machine) {
+  machine.memory[0x10] = 0x00;
+  machine.memory[0x11] = 0x05;
+  machine.MapPages(0x0000, 0x10000, machine.memory, machine.memory);
+  machine.Reset();
+}
+
+// FNV-1a over memory, a word at a time, the registers and the cycle counter.
+static uint64_t Hash(const Machine &machine) {
+  uint64_t hash = 14695981039346656037ull;
+  const auto mix = [&hash](uint64_t value) { hash = (hash ^ value) * 1099511628211ull; };
+  for (size_t offset = 0; offset < sizeof(machine.memory); offset += 8) {
+    uint64_t word;
+    std::memcpy(&word, machine.memory + offset, sizeof(word));
+    mix(word);
+  }
+  const auto registers = machine.GetRegisters();
+  mix(registers.PC); mix(registers.A); mix(registers.X); mix(registers.Y); mix(registers.S); mix(registers.P);
+  mix(machine.Cycles());
+  return hash;
+}
+
+int main() {
+  static constexpr int STEPS = 8000;
+
+  // The state at every instruction boundary, from a plain run.
+  static Machine reference(CODE, 0x0200);
+  Boot(reference);
+  std::vector<uint64_t> hashes;
+  for (int step = 0; step <= STEPS; step++) {
+    hashes.push_back(Hash(reference));
+    reference.Step();
+  }
+
+  // The same run through Rewind, with a keyframe every 1000 cycles.
+  static Machine machine(CODE, 0x0200);
+  Boot(machine);
+  Rewind<Machine>::Config config;
+  config.interval  = 1000;
+  config.keyframes = 64;
+  config.journal   = 1 << 16;
+  Rewind<Machine> rewind(machine, config);
+
+  size_t position = 0;
+  while (position < STEPS) {
+    rewind.Step();
+    position++;
+  }
+  Check(Hash(machine) == hashes[position], "Rewind::Step() runs as Step() does");
+
+  // One instruction, then across one keyframe, then across several.
+  for (uint64_t back : { 1, 3, 400, 2500, 1, 3000 }) {
+    if (!rewind.StepBack(back)) {
+      Check(false, "StepBack() within the history");
+      break;
+    }
+    position -= back;
+    Check(Hash(machine) == hashes[position], "StepBack() lands on the recorded state");
+  }
+
+  // Further back than the oldest keyframe.
+  const uint64_t oldest  = rewind.Oldest();
+  const uint64_t refused = machine.Cycles();
+  const uint64_t before  = Hash(machine);
+  Check(!rewind.StepBack(STEPS), "StepBack() past the oldest keyframe is refused");
+  Check(Hash(machine) == before, "a refused StepBack() leaves the machine alone");
+  Check(rewind.Oldest() == oldest, "a refused StepBack() keeps the history");
+  Check(rewind.StepBack(1) && Hash(machine) == hashes[--position], "StepBack() works after a refusal");
+
+  // Forward again to the end of the reference run.
+  while (position < STEPS) {
+    rewind.Step();
+    position++;
+  }
+  Check(Hash(machine) == hashes[STEPS], "running on after StepBack() retraces the original run");
+
+  // Once the oldest keyframe ages out, the one after it takes over, not one
+  // taken after the refusal.
+  while (rewind.Oldest() == oldest) { rewind.Step(); }
+  Check(rewind.Oldest() < refused, "a refused StepBack() keeps the newer keyframes");
+
+  return Report("rewind");
+}
@@ -0,0 +1,104 @@
+//
+// save_state.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <iterator>
+#include <memory>
+#include "common.h"
+
+//
+// SaveState() then LoadState() must carry the registers, interrupt lines and
+// cycle count across to another CPU, which then runs on exactly as the
+// original; a short buffer, a foreign magic or another version must be
+// refused without touching the CPU.
+//
+
+// INX; INY; JMP $0200, with the NMI handler at $0300 counting into $10 and
+// the IRQ handler at $0310 into $11, each returning to the loop.
+static std::unique_ptr<Machine> Boot() {
+  auto machine = std::make_unique<Machine>(std::initializer_list<uint8_t>{ 0xE8, 0xC8, 0x4C, 0x00, 0x02 }, 0x0200);
+  const uint8_t nmi[] = { 0xE6, 0x10, 0x40 };  // INC $10; RTI
+  const uint8_t irq[] = { 0xE6, 0x11, 0x40 };  // INC $11; RTI
+  std::copy(std::begin(nmi), std::end(nmi), machine->memory + 0x0300);
+  std::copy(std::begin(irq), std::end(irq), machine->memory + 0x0310);
+  machine->memory[0xFFFA] = 0x00; machine->memory[0xFFFB] = 0x03;
+  machine->memory[0xFFFE] = 0x10; machine->memory[0xFFFF] = 0x03;
+  machine->Reset();
+  return machine;
+}
+
+static bool SameRegisters(const Machine &a, const Machine &b) {
+  const auto ra = a.GetRegisters();
+  const auto rb = b.GetRegisters();
+  return a.Cycles() == b.Cycles() && ra.PC == rb.PC && ra.A == rb.A && ra.X == rb.X && ra.Y == rb.Y
+      && ra.S == rb.S && ra.P == rb.P;
+}
+
+// A CPU partway through a run, with I set, both lines raised and odd
+// register values, restored onto a fresh one.
+static void RoundTrip() {
+  const auto original = Boot();
+  const auto restored = Boot();
+  original->Run(1234);
+  original->SetRegisters({ 0x0201, 0x9C, 0x37, 0xE1, 0xF0, 0xE5 });
+  original->Signal(Machine::NMI, true);
+  original->Signal(Machine::IRQ, true);
+
+  uint8_t state[Machine::STATE_SIZE];
+  uint8_t again[Machine::STATE_SIZE];
+  Check(!original->SaveState(state, sizeof(state) - 1), "SaveState() refuses a short buffer");
+  Check(original->SaveState(state, sizeof(state)) == Machine::STATE_SIZE, "SaveState() writes STATE_SIZE bytes");
+  Check(restored->LoadState(state, sizeof(state)) == Machine::STATE_SIZE, "LoadState() reads STATE_SIZE bytes");
+  Check(SameRegisters(*original, *restored), "registers and cycles survive a round trip");
+  Check(restored->SaveState(again, sizeof(again)) && !std::memcmp(state, again, sizeof(state)),
+        "a restored CPU saves the same bytes, lines included");
+
+  // The NMI latch comes across and is taken once; the IRQ line waits for I.
+  original->Run(1000);
+  restored->Run(1000);
+  Check(SameState(*original, *restored) && restored->memory[0x10] == 1 && restored->memory[0x11] == 0,
+        "a restored CPU takes the saved NMI and runs on as the original");
+
+  Machine::Registers registers = original->GetRegisters();
+  registers.P &= ~0x04;
+  original->SetRegisters(registers);
+  restored->SetRegisters(registers);
+  original->Run(100);
+  restored->Run(100);
+  Check(SameState(*original, *restored) && restored->memory[0x11] > 0, "the saved IRQ line is still raised");
+}
+
+// Each damaged buffer is refused and the CPU is left as it was.
+static void Refusals() {
+  const auto source = Boot();
+  const auto target = Boot();
+  source->Run(5000);
+  target->Run(300);
+
+  uint8_t state[Machine::STATE_SIZE];
+  uint8_t before[Machine::STATE_SIZE];
+  uint8_t after[Machine::STATE_SIZE];
+  source->SaveState(state, sizeof(state));
+  target->SaveState(before, sizeof(before));
+
+  uint8_t magic[Machine::STATE_SIZE];
+  std::memcpy(magic, state, sizeof(state));
+  magic[1] = 'X';
+  uint8_t version[Machine::STATE_SIZE];
+  std::memcpy(version, state, sizeof(state));
+  version[3] = Machine::STATE_VERSION + 1;
+
+  Check(!target->LoadState(state, sizeof(state) - 1), "LoadState() refuses a short buffer");
+  Check(!target->LoadState(magic, sizeof(magic)), "LoadState() refuses a foreign magic");
+  Check(!target->LoadState(version, sizeof(version)), "LoadState() refuses another version");
+  target->SaveState(after, sizeof(after));
+  Check(!std::memcmp(before, after, sizeof(before)), "a refused state leaves the CPU unchanged");
+}
+
+int main() {
+  RoundTrip();
+  Refusals();
+
+  return Report("save_state");
+}
@@ -0,0 +1,110 @@
+//
+// scheduler.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "common.h"
+
+//
+// Events must run at the first instruction boundary at or after their
+// cycle, those due together in the order they were scheduled; a cancelled
+// event must never run; and a callback may schedule and cancel events,
+// including ones due at once. Each case runs on the in-place and the mapped
+// core.
+//
+
+// INX; JMP $0200 forever, with the longest instruction 3 cycles.
+static std::unique_ptr<Machine> Boot(bool mapped) {
+  auto machine = std::make_unique<Machine>(std::initializer_list<uint8_t>{ 0xE8, 0x4C, 0x00, 0x02 }, 0x0200);
+  if (mapped) { machine->MapPages(0x0000, 0x10000, machine->memory, machine->memory); }
+  machine->Reset();
+  return machine;
+}
+
+struct Call {
+  int tag;
+  uint64_t due;
+  uint64_t cycle;
+};
+
+static bool OnTime(const std::vector<Call> &calls) {
+  for (const Call &call : calls) {
+    if (call.cycle < call.due || call.cycle >= call.due + 3) { return false; }
+  }
+  return true;
+}
+
+static bool Tags(const std::vector<Call> &calls, std::initializer_list<int> expected) {
+  if (calls.size() != expected.size()) { return false; }
+  return std::equal(expected.begin(), expected.end(), calls.begin(), [](int tag, const Call &call) { return tag == call.tag; });
+}
+
+// Scheduled out of order, with three due on the same cycle; 4 and 6 are
+// cancelled, and cancelling an id that is gone does nothing.
+static void Ordering(bool mapped) {
+  auto machine = Boot(mapped);
+  const uint64_t start = machine->Cycles();
+  std::vector<Call> calls;
+  const auto schedule = [&](int tag, uint64_t due) {
+    return machine->Schedule(start + due, [&, tag, due] { calls.push_back({ tag, start + due, machine->Cycles() }); });
+  };
+
+  schedule(5, 900);
+  schedule(2, 500);
+  const uint32_t four = schedule(4, 500);
+  schedule(3, 500);
+  schedule(1, 100);
+  const uint32_t six = schedule(6, 700);
+  schedule(7, 700);
+
+  machine->Cancel(four);
+  machine->Cancel(six);
+  machine->Run(2000);
+  machine->Cancel(six);
+  machine->Cancel(12345);
+  machine->Run(2000);
+
+  Check(Tags(calls, { 1, 2, 3, 7, 5 }), "events run by cycle, then in the order scheduled, less the cancelled");
+  Check(OnTime(calls), "each event runs at the first boundary at or after its cycle");
+  Check(calls.size() == 5 && calls[1].cycle == calls[2].cycle, "events due together run on the same boundary");
+}
+
+// A callback re-arms itself every 250 cycles; one pass schedules an event
+// due on the next pass's cycle, which that pass cancels before it can run,
+// and schedules another due at once.
+static void Rearming(bool mapped) {
+  auto machine = Boot(mapped);
+  const uint64_t start = machine->Cycles();
+  std::vector<Call> calls;
+  uint32_t victim = 0;
+
+  std::function<void(int, uint64_t)> tick = [&](int count, uint64_t due) {
+    calls.push_back({ 0, due, machine->Cycles() });
+    if (count < 9) { machine->Schedule(due + 250, [&tick, count, due] { tick(count + 1, due + 250); }); }
+    if (count == 1) { victim = machine->Schedule(due + 250, [&] { calls.push_back({ 2, 0, 0 }); }); }
+    if (count == 2) {
+      machine->Cancel(victim);
+      machine->Schedule(machine->Cycles(), [&] { calls.push_back({ 1, machine->Cycles(), machine->Cycles() }); });
+    }
+  };
+  machine->Schedule(start + 250, [&tick, start] { tick(0, start + 250); });
+
+  machine->Run(5000);
+
+  Check(Tags(calls, { 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }), "a callback re-arms itself and schedules for now");
+  Check(OnTime(calls), "re-armed events run on time");
+  Check(calls.size() == 11 && calls[3].cycle == calls[2].cycle, "an event due at once runs on the same boundary");
+}
+
+int main() {
+  for (bool mapped : { false, true }) {
+    Ordering(mapped);
+    Rearming(mapped);
+  }
+
+  return Report("scheduler");
+}
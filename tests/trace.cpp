@@ -0,0 +1,193 @@
+//
+// trace.cpp
+// by Naomi Peori <naomi@peori.ca>
+//
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common.h"
+
+//
+// Traced runs must render as nestest.log does, and a snapshot taken from
+// another thread while the CPU fills the ring must hold only whole records.
+//
+
+using Illegal = TestMachine<Nmos6502Illegal>;
+
+static std::vector<std::string> Render(const TraceBuffer &trace) {
+  std::vector<TraceRecord> records(trace.Capacity());
+  records.resize(trace.Snapshot(records.data(), records.size()));
+
+  std::vector<std::string> lines;
+  char line[128];
+  for (const TraceRecord &record : records) {
+    FormatNestest(record, line, sizeof(line));
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+static bool SameLines(const std::vector<std::string> &lines, std::initializer_list<const char *> expected) {
+  if (lines.size() != expected.size()) { return false; }
+  size_t index = 0;
+  for (const char *line : expected) {
+    if (lines[index] != line) {
+      std::printf("  got      %s\n  expected %s\n", lines[index].c_str(), line);
+      return false;
+    }
+    index++;
+  }
+  return true;
+}
+
+// The opening of nestest, from $C000 with P=$24, SP=$FD and 7 cycles of
+// reset behind it, against the first ten lines of nestest.log with their
+// "= xx" values and PPU column cut.
+static void Nestest() {
+  const auto machine = std::make_unique<Illegal>();
+  const auto poke = [&](uint16_t address, std::initializer_list<uint8_t> bytes) {
+    std::copy(bytes.begin(), bytes.end(), machine->memory + address);
+  };
+  poke(0xC000, { 0x4C, 0xF5, 0xC5 });
+  poke(0xC5F5, { 0xA2, 0x00, 0x86, 0x00, 0x86, 0x10, 0x86, 0x11, 0x20, 0x2D, 0xC7 });
+  poke(0xC72D, { 0xEA, 0x38, 0xB0, 0x04 });
+  poke(0xC735, { 0xEA });
+
+  uint8_t state[Illegal::STATE_SIZE];
+  machine->SetRegisters({ 0xC000, 0x00, 0x00, 0x00, 0xFD, 0x24 });
+  machine->SaveState(state, sizeof(state));
+  state[17] = 7;
+  machine->LoadState(state, sizeof(state));
+
+  TraceBuffer trace(16);
+  machine->SetTrace(&trace);
+  while (trace.Count() < 10) { machine->Step(); }
+
+  Check(SameLines(Render(trace), {
+    "C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD CYC:7",
+    "C5F5  A2 00     LDX #$00                        A:00 X:00 Y:00 P:24 SP:FD CYC:10",
+    "C5F7  86 00     STX $00                         A:00 X:00 Y:00 P:26 SP:FD CYC:12",
+    "C5F9  86 10     STX $10                         A:00 X:00 Y:00 P:26 SP:FD CYC:15",
+    "C5FB  86 11     STX $11                         A:00 X:00 Y:00 P:26 SP:FD CYC:18",
+    "C5FD  20 2D C7  JSR $C72D                       A:00 X:00 Y:00 P:26 SP:FD CYC:21",
+    "C72D  EA        NOP                             A:00 X:00 Y:00 P:26 SP:FB CYC:27",
+    "C72E  38        SEC                             A:00 X:00 Y:00 P:26 SP:FB CYC:29",
+    "C72F  B0 04     BCS $C735                       A:00 X:00 Y:00 P:27 SP:FB CYC:31",
+    "C735  EA        NOP                             A:00 X:00 Y:00 P:27 SP:FB CYC:34",
+  }), "the opening of nestest renders as nestest.log");
+}
+
+// Undocumented opcodes are starred and ISC is spelled ISB, a backward branch
+// shows its target, and P shows U set and B clear even after PLP pulls B.
+static void Conventions() {
+  const auto machine = std::make_unique<Illegal>(std::initializer_list<uint8_t>{
+    0xA9, 0x10,        // $0600: LDA #$10
+    0x48,              // $0602: PHA
+    0x28,              // $0603: PLP, pulling B set and U clear
+    0xE7, 0x40,        // $0604: ISB $40
+    0x80, 0x7F,        // $0606: NOP #$7F
+    0xA7, 0x40,        // $0608: LAX $40
+    0xD0, 0xF4,        // $060A: BNE $0600
+  }, 0x0600);
+  machine->memory[0x40] = 0x41;
+  machine->Reset();
+  machine->SetRegisters({ 0x0600, 0x00, 0x00, 0x00, 0xFD, 0x24 });
+
+  TraceBuffer trace(16);
+  machine->SetTrace(&trace);
+  const uint64_t start = machine->Cycles();
+  while (trace.Count() < 7) { machine->Step(); }
+
+  std::vector<std::string> lines = Render(trace);
+  for (std::string &line : lines) { line.erase(line.rfind(" CYC:")); }
+
+  Check(SameLines(lines, {
+    "0600  A9 10     LDA #$10                        A:00 X:00 Y:00 P:24 SP:FD",
+    "0602  48        PHA                             A:10 X:00 Y:00 P:24 SP:FD",
+    "0603  28        PLP                             A:10 X:00 Y:00 P:24 SP:FC",
+    "0604  E7 40    *ISB $40                         A:10 X:00 Y:00 P:20 SP:FD",
+    "0606  80 7F    *NOP #$7F                        A:CD X:00 Y:00 P:A0 SP:FD",
+    "0608  A7 40    *LAX $40                         A:CD X:00 Y:00 P:A0 SP:FD",
+    "060A  D0 F4     BNE $0600                       A:42 X:42 Y:00 P:20 SP:FD",
+  }), "undocumented opcodes, branches and P render as in nestest.log");
+
+  char line[128];
+  TraceRecord last;
+  trace.Snapshot(&last, 1);
+  FormatNestest(last, line, sizeof(line));
+  Check(std::to_string(last.cycle) == std::string(line).substr(std::string(line).rfind(':') + 1)
+        && last.cycle - start == 2 + 3 + 4 + 5 + 2 + 3, "CYC is the cycle count before the instruction");
+}
+
+// DumpNestest() writes the same lines, one per record.
+static void Dump() {
+  const auto machine = std::make_unique<Machine>(std::initializer_list<uint8_t>{ 0xE8, 0x4C, 0x00, 0x02 }, 0x0200);
+  machine->Reset();
+  TraceBuffer trace(8);
+  machine->SetTrace(&trace);
+  machine->Run(100);
+
+  std::FILE *file = std::tmpfile();
+  DumpNestest(trace, file, 3);
+  std::rewind(file);
+  std::string text;
+  for (int c; (c = std::fgetc(file)) != EOF; ) { text += static_cast<char>(c); }
+  std::fclose(file);
+
+  std::string expected;
+  const std::vector<std::string> lines = Render(trace);
+  for (size_t index = lines.size() - 3; index < lines.size(); index++) { expected += lines[index] + "\n"; }
+  Check(text == expected, "DumpNestest writes the most recent records, one line each");
+}
+
+// A reader snapshots a small ring as fast as it can while the CPU laps it.
+// Before INX and JMP X equals Y, and before INY it is one more, so a record
+// mixing two instructions' registers breaks the pattern.
+static void Concurrent() {
+  const auto machine = std::make_unique<Machine>(std::initializer_list<uint8_t>{
+    0xE8, 0xC8, 0x4C, 0x00, 0x02,  // $0200: INX, INY, JMP $0200
+  }, 0x0200);
+  machine->MapPages(0x0000, 0x10000, machine->memory, machine->memory);
+  machine->Reset();
+
+  TraceBuffer trace(64);
+  machine->SetTrace(&trace);
+
+  std::atomic<bool> done = false;
+  bool whole = true, ordered = true;
+  size_t snapshots = 0;
+  std::thread reader([&] {
+    std::vector<TraceRecord> records(trace.Capacity());
+    while (!done.load(std::memory_order_relaxed)) {
+      const size_t count = trace.Snapshot(records.data(), records.size());
+      for (size_t index = 0; index < count; index++) {
+        const TraceRecord &record = records[index];
+        const uint8_t expected = static_cast<uint8_t>(record.Y + (record.pc == 0x0201));
+        whole &= record.X == expected && record.opcode == machine->memory[record.pc];
+        if (index) { ordered &= record.cycle > records[index - 1].cycle; }
+      }
+      snapshots++;
+    }
+  });
+
+  machine->Run(20'000'000);
+  done = true;
+  reader.join();
+
+  Check(whole, "a snapshot taken while the CPU runs holds only whole records");
+  Check(ordered, "a snapshot taken while the CPU runs is in order");
+  Check(snapshots > 0, "the reader took snapshots");
+}
+
+int main() {
+  Nestest();
+  Conventions();
+  Dump();
+  Concurrent();
+
+  return Report("trace");
+}